@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,86 +12,392 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To keep several requests in flight, pass locked buffers
+//     to bio_submit and then wait for each with bio_wait.
 //
 // The implementation uses two state flags internally:
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Locking: each hash bucket has its own lock, which protects
+// the chain and the refcnt and used bit of the buffers on it,
+// so lookups of different blocks do not contend.  Recycling a
+// buffer for a new block moves it between buckets and queues;
+// bcache.lock serializes that, and is always acquired before
+// any bucket lock.
+//
+// The cache is sized at boot to a fraction of free memory.
+// Replacement is a simplified 2Q, so that one pass over a big
+// file cannot flush frequently used blocks such as inodes and
+// bitmaps.  A block read in joins the cold queue, a FIFO.  If it
+// is used again before it reaches the head of the cold queue,
+// it moves to the hot queue, which is managed by CLOCK.  A block
+// brought in by read-ahead has not been used yet, so it takes
+// two uses to make it hot.  Victims
+// come from the cold queue while it holds more than a quarter of
+// the cache, otherwise from the hot queue.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "iostat.h"
 
-struct {
+#define NBUCKET 1021
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;  // chain through buf.hnext
+  uint hits;
+};
+
+// Protects the I/O state of every buffer (B_VALID and B_DIRTY
+// while a request is in flight) for bio_wait() and biodone(),
+// and the request statistics.
+static struct spinlock biolock;
+
+struct {
+  struct spinlock lock;  // eviction
+  struct bucket bucket[NBUCKET];
+  struct buf *free;      // never used, chained through hnext
+  int nbuf;
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+  // Replacement queues, through prev/next.
+  // head.next is the next to be considered for eviction.
+  struct buf cold;
+  struct buf hot;
+  int ncold;
+  int nhot;
+  uint misses;
+
+  // Request statistics, protected by biolock.
+  uint nreq;
+  uint lat;
+  uint latmax;
 } bcache;
 
+static struct bucket*
+hash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
+static void
+qinit(struct buf *q)
+{
+  q->prev = q;
+  q->next = q;
+}
+
+static void
+qremove(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
+// Append b to the tail of queue q.
+static void
+qappend(struct buf *q, struct buf *b)
+{
+  b->next = q;
+  b->prev = q->prev;
+  q->prev->next = b;
+  q->prev = b;
+}
+
+// Allocate the buffer cache from free memory.  Must be called
+// after kinit2(), and before any file system activity.
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
+  char *hdr, *data;
+  int nhdr, ndata, n;
 
   initlock(&bcache.lock, "bcache");
+  initlock(&biolock, "bio");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache.bucket");
+  qinit(&bcache.cold);
+  qinit(&bcache.hot);
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  // Carve buf headers and block data out of separate pages.
+  n = kfreepages() / BCACHEDIV * (PGSIZE / BSIZE);
+  if(n < NBUF)
+    n = NBUF;
+  hdr = data = 0;
+  nhdr = ndata = 0;
+  while(bcache.nbuf < n){
+    if(nhdr == 0){
+      if((hdr = kalloc()) == 0)
+        break;
+      nhdr = PGSIZE / sizeof(struct buf);
+    }
+    if(ndata == 0){
+      if((data = kalloc()) == 0)
+        break;
+      ndata = PGSIZE / BSIZE;
+    }
+    b = (struct buf*)hdr;
+    memset(b, 0, sizeof(*b));
+    hdr += sizeof(*b);
+    nhdr--;
+    b->data = (uchar*)data;
+    data += BSIZE;
+    ndata--;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->hnext = bcache.free;
+    bcache.free = b;
+    bcache.nbuf++;
   }
+  if(bcache.nbuf < NBUF)
+    panic("binit: no memory");
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Look for block on device dev in bucket bk, which must be
+// locked.  If found, take a reference to it.
 static struct buf*
-bget(uint dev, uint blockno)
+lookup(struct bucket *bk, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->hnext){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+      if(b->used < 2)
+        b->used++;
+      bk->hits++;
       return b;
     }
   }
+  return 0;
+}
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+// Look at up to n buffers from the head of queue q for one
+// to recycle.  Unlinks the victim from its bucket and q.
+// Caller holds bcache.lock.
+static struct buf*
+scan(struct buf *q, int n)
+{
+  struct buf *b, **pp;
+  struct bucket *bk;
+
+  for(; n > 0 && q->next != q; n--){
+    b = q->next;
+    bk = hash(b->dev, b->blockno);
+    acquire(&bk->lock);
+    // Even if refcnt==0, B_DIRTY indicates a buffer is in use
+    // because log.c has modified it but not yet checkpointed it.
+    if(b->refcnt != 0 || (b->flags & B_DIRTY) != 0){
+      qremove(b);
+      qappend(q, b);
+      release(&bk->lock);
+      continue;
+    }
+    if(b->used > (q == &bcache.cold)){
+      // Second chance; a cold buffer used again is hot.
+      b->used = 0;
+      qremove(b);
+      if(q == &bcache.cold){
+        bcache.ncold--;
+        bcache.nhot++;
+      }
+      qappend(&bcache.hot, b);
+      release(&bk->lock);
+      continue;
     }
+    for(pp = &bk->head; *pp != b; pp = &(*pp)->hnext)
+      ;
+    *pp = b->hnext;
+    qremove(b);
+    if(q == &bcache.cold)
+      bcache.ncold--;
+    else
+      bcache.nhot--;
+    release(&bk->lock);
+    return b;
+  }
+  return 0;
+}
+
+// Choose a buffer to recycle.  Caller holds bcache.lock.
+static struct buf*
+evict(void)
+{
+  struct buf *b;
+
+  if((b = bcache.free) != 0){
+    bcache.free = b->hnext;
+    return b;
   }
+  if(bcache.ncold > bcache.nbuf/4 && (b = scan(&bcache.cold, bcache.ncold)))
+    return b;
+  if((b = scan(&bcache.hot, 2*bcache.nhot)) != 0)
+    return b;
+  if((b = scan(&bcache.cold, 2*bcache.ncold)) != 0)
+    return b;
   panic("bget: no buffers");
 }
 
+// Recycle a buffer to hold block blockno of device dev, which
+// hashes to bucket bk, with one reference and the given use
+// count.  Caller holds bcache.lock and has checked that the
+// block is not cached.
+static struct buf*
+recycle(struct bucket *bk, uint dev, uint blockno, int used)
+{
+  struct buf *b;
+
+  b = evict();
+  acquire(&bk->lock);
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  b->used = used;
+  b->hnext = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+  qappend(&bcache.cold, b);
+  bcache.ncold++;
+  return b;
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct buf *b;
+  struct bucket *bk;
+
+  bk = hash(dev, blockno);
+  acquire(&bk->lock);
+  b = lookup(bk, dev, blockno);
+  release(&bk->lock);
+  if(b){
+    acquiresleep(&b->lock);
+    return b;
+  }
+
+  // Not cached.  Another process may have added the block
+  // while we waited for bcache.lock, so look again.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  b = lookup(bk, dev, blockno);
+  release(&bk->lock);
+  if(b == 0){
+    bcache.misses++;
+    b = recycle(bk, dev, blockno, 1);
+  }
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Completion callback for read-ahead.  Releases b on behalf of
+// the process that started the read.
+static void
+bradone(struct buf *b)
+{
+  struct bucket *bk;
+
+  releasesleep(&b->lock);
+  bk = hash(b->dev, b->blockno);
+  acquire(&bk->lock);
+  b->refcnt--;
+  release(&bk->lock);
+}
+
+// Start reading block blockno of device dev into the cache,
+// unless it is there already, and return without waiting.
+void
+breada(uint dev, uint blockno)
+{
+  struct buf *b;
+  struct bucket *bk;
+
+  bk = hash(dev, blockno);
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      break;
+  release(&bk->lock);
+  if(b){
+    release(&bcache.lock);
+    return;
+  }
+  b = recycle(bk, dev, blockno, 0);
+  release(&bcache.lock);
+
+  // Someone may have locked and read b before us.
+  acquiresleep(&b->lock);
+  if(b->flags & B_VALID){
+    brelse(b);
+    return;
+  }
+  bio_submit(b, bradone);
+}
+
+//PAGEBREAK!
+// Start syncing locked buffer b with disk, without waiting:
+// a write if B_DIRTY is set, else a read.  If done is not 0,
+// biodone() calls it when the request has finished, often from
+// an interrupt handler, so it must not sleep.  The caller keeps
+// b locked until then; bio_wait() waits for that.
+void
+bio_submit(struct buf *b, void (*done)(struct buf*))
+{
+  if(!holdingsleep(&b->lock))
+    panic("bio_submit");
+  b->done = done;
+  b->qtime = ticks;
+  idesubmit(b);
+}
+
+// Wait for the request on b started by bio_submit() to finish.
+void
+bio_wait(struct buf *b)
+{
+  acquire(&biolock);
+  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID)
+    sleep(b, &biolock);
+  release(&biolock);
+}
+
+// Called by the disk driver when the request on b has finished.
+void
+biodone(struct buf *b)
+{
+  void (*done)(struct buf*);
+  uint lat;
+
+  acquire(&biolock);
+  lat = ticks - b->qtime;
+  bcache.nreq++;
+  bcache.lat += lat;
+  if(lat > bcache.latmax)
+    bcache.latmax = lat;
+  b->flags |= B_VALID;
+  b->flags &= ~B_DIRTY;
+  done = b->done;
+  b->done = 0;
+  if(done)
+    done(b);
+  wakeup(b);
+  release(&biolock);
+}
+
 // Return a locked buf with the contents of the indicated block.
 struct buf*
 bread(uint dev, uint blockno)
@@ -100,7 +406,8 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if((b->flags & B_VALID) == 0) {
-    iderw(b);
+    bio_submit(b, 0);
+    bio_wait(b);
   }
   return b;
 }
@@ -112,32 +419,47 @@ bwrite(struct buf *b)
   if(!holdingsleep(&b->lock))
     panic("bwrite");
   b->flags |= B_DIRTY;
-  iderw(b);
+  bio_submit(b, 0);
+  bio_wait(b);
 }
 
 // Release a locked buffer.
-// Move to the head of the MRU list.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = hash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
+  release(&bk->lock);
+}
+
+// Report buffer cache statistics.
+void
+bstat(struct iostat *st)
+{
+  struct bucket *bk;
+
+  memset(st, 0, sizeof(*st));
+  acquire(&bcache.lock);
+  st->nbuf = bcache.nbuf;
+  st->nhot = bcache.nhot;
+  st->misses = bcache.misses;
   release(&bcache.lock);
+  acquire(&biolock);
+  st->nreq = bcache.nreq;
+  st->lat = bcache.lat;
+  st->latmax = bcache.latmax;
+  release(&biolock);
+  iosched_stat(st);
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    st->hits += bk->hits;
 }
 //PAGEBREAK!
 // Blank page.
@@ -4,10 +4,15 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  int used;          // uses since last considered for eviction
+  struct buf *hnext; // hash chain
+  struct buf *prev;  // replacement queue
   struct buf *next;
   struct buf *qnext; // disk queue
-  uchar data[BSIZE];
+  struct buf *fnext; // disk queue, in arrival order
+  uint qtime;        // ticks when the request was submitted
+  void (*done)(struct buf*); // called when the disk request finishes
+  uchar *data;       // BSIZE bytes
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
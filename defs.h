@@ -1,7 +1,10 @@
 struct buf;
 struct context;
 struct file;
+struct imgseg;
 struct inode;
+struct iostat;
+struct iovec;
 struct pipe;
 struct proc;
 struct rtcdate;
@@ -15,6 +18,11 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bstat(struct iostat*);
+void            breada(uint, uint);
+void            bio_submit(struct buf*, void (*)(struct buf*));
+void            bio_wait(struct buf*);
+void            biodone(struct buf*);
 
 // console.c
 void            consoleinit(void);
@@ -33,13 +41,23 @@ void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filepread(struct file*, char*, int n, uint off);
+int             filepwrite(struct file*, char*, int n, uint off);
+int             filesend(struct file*, struct file*, uint*, int);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
+void            dirforget(struct inode*, char*);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   itext(struct inode*);
+void            iputtext(struct inode*);
+int             iwopen(struct inode*);
+void            iwclose(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -50,24 +68,34 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+int             sendi(struct inode*, struct pipe*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
-void            iderw(struct buf*);
+void            idesubmit(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
 extern uchar    ioapicid;
 void            ioapicinit(void);
+void            ioapicroute(int irq, int vec, int cpu);
+
+// iosched.c
+void            ioschedinit(void);
+void            iosched_add(struct buf*);
+struct buf*     iosched_next(void);
+struct buf*     iosched_take(uint, uint, int);
+void            iosched_stat(struct iostat*);
 
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+int             kfreepages(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -84,6 +112,10 @@ void            microdelay(int);
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
+void            log_sync(void);
+void            log_syncto(int);
+int             log_opseq(void);
+void            log_stat(struct iostat*);
 void            begin_op();
 void            end_op();
 
@@ -95,11 +127,20 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pci.c
+uint            pciread(int, int);
+void            pciwrite(int, int, uint);
+int             pcifindid(uint, uint);
+int             pcifindclass(uint, uint);
+void            pcimaster(int);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipewait(struct pipe*);
+int             pipeput(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
 // proc.c
@@ -108,6 +149,7 @@ void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+void            kthread(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -151,8 +193,10 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argwptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
+int             fetchptr(uint, char**, int);
 int             fetchstr(uint, char**);
 void            syscall(void);
 
@@ -179,12 +223,25 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             faultuvm(struct proc*, uint);
+uint            limituvm(struct proc*, uint);
+int             writableuvm(struct proc*, uint, uint);
+int             shareduvm(struct proc*, uint);
+int             touchuvm(struct proc*, uint, uint);
+void            freeimgseg(struct imgseg*);
+int             mmapuvm(struct proc*, uint, int, int, struct file*, uint);
+int             munmapuvm(struct proc*, uint, uint);
+void            freevmas(struct proc*);
+int             copyvmas(struct proc*, struct proc*);
+void            shinit(void);
+void            shread(struct inode*, char*, uint, uint);
+void            shwrite(struct inode*, char*, uint, uint);
+int             shmapped(struct inode*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -2,3 +2,10 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+
+// mmap() protection and flags
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+#define MAP_SHARED    0x01  // changes are written back to the file
+#define MAP_PRIVATE   0x02  // changes stay in this process
+#define MAP_ANONYMOUS 0x20  // zero-filled memory, no file
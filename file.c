@@ -5,10 +5,13 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
+#include "mmu.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -73,6 +76,8 @@ fileclose(struct file *f)
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
   else if(ff.type == FD_INODE){
+    if(ff.writable)
+      iwclose(ff.ip);
     begin_op();
     iput(ff.ip);
     end_op();
@@ -92,23 +97,66 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+// Write a few blocks at a time to avoid exceeding
+// the maximum log transaction size, including
+// i-node, two allocation blocks, two pointer blocks
+// at each of three levels of indirection,
+// and 1 block of slop for non-aligned writes.
+// This really belongs lower down, since writei()
+// might be writing a device like the console.
+#define MAXWRITE ((MAXOPBLOCKS-1-2-2*3-1) * BSIZE)
+
+// Read from the inode behind f at *off, advancing *off.
+static int
+inoderead(struct file *f, char *addr, int n, uint *off)
+{
+  int r;
+
+  ilock(f->ip);
+  if((r = readi(f->ip, addr, *off, n)) > 0)
+    *off += r;
+  iunlock(f->ip);
+  return r;
+}
+
+// Write to the inode behind f at *off, advancing *off.
+static int
+inodewrite(struct file *f, char *addr, int n, uint *off)
+{
+  int r;
+  int max = MAXWRITE;
+  int i = 0;
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+
+    begin_op();
+    ilock(f->ip);
+    if ((r = writei(f->ip, addr + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(f->ip);
+    end_op();
+
+    if(r < 0)
+      break;
+    if(r != n1)
+      panic("short filewrite");
+    i += r;
+  }
+  return i == n ? n : -1;
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
 {
-  int r;
-
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
     return piperead(f->pipe, addr, n);
-  if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
-    return r;
-  }
+  if(f->type == FD_INODE)
+    return inoderead(f, addr, n, &f->off);
   panic("fileread");
 }
 
@@ -117,41 +165,147 @@ fileread(struct file *f, char *addr, int n)
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
-
   if(f->writable == 0)
     return -1;
   if(f->type == FD_PIPE)
     return pipewrite(f->pipe, addr, n);
-  if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r < 0)
+  if(f->type == FD_INODE)
+    return inodewrite(f, addr, n, &f->off);
+  panic("filewrite");
+}
+
+// Read from file f at offset off, without using or moving
+// f->off.  Only files backed by an inode have offsets.
+int
+filepread(struct file *f, char *addr, int n, uint off)
+{
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  return inoderead(f, addr, n, &off);
+}
+
+// Write to file f at offset off, without using or moving f->off.
+int
+filepwrite(struct file *f, char *addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return inodewrite(f, addr, n, &off);
+}
+
+// Read from file f into each of the cnt buffers in iov in turn,
+// stopping at the first short read.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, tot;
+
+  if(f->readable == 0)
+    return -1;
+  for(tot = i = 0; i < cnt; i++){
+    if((r = fileread(f, iov[i].base, iov[i].len)) < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r < iov[i].len)
+      break;
+  }
+  return tot;
+}
+
+// Write each of the cnt buffers in iov to file f in turn.
+// If f is an inode and they fit in one log transaction,
+// they share it.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, n, r, tot;
+
+  if(f->writable == 0)
+    return -1;
+  for(n = i = 0; i < cnt && n <= MAXWRITE; i++)
+    n += iov[i].len;
+  if(f->type == FD_INODE && n <= MAXWRITE){
+    r = 0;
+    begin_op();
+    ilock(f->ip);
+    for(tot = i = 0; i < cnt; i++){
+      if((r = writei(f->ip, iov[i].base, f->off, iov[i].len)) < 0)
         break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
+      f->off += r;
+      tot += r;
     }
-    return i == n ? n : -1;
+    iunlock(f->ip);
+    end_op();
+    return tot > 0 ? tot : r;
   }
-  panic("filewrite");
+
+  for(tot = i = 0; i < cnt; i++){
+    if((r = filewrite(f, iov[i].base, iov[i].len)) < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+  }
+  return tot;
 }
 
+// Move up to n bytes from in to out without going through user
+// space, reading in at *off, or at in->off if off is 0.
+// File to pipe goes straight from the buffer cache into the
+// pipe, unless the file is mapped shared and the buffer cache
+// may lack stores to the mapping; everything else goes through
+// a kernel page.
+int
+filesend(struct file *out, struct file *in, uint *off, int n)
+{
+  int r, m, tot, eof;
+  char *page;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(off == 0)
+    off = &in->off;
+  else if(in->type != FD_INODE)
+    return -1;
+
+  r = 0;
+  tot = 0;
+  if(in->type == FD_INODE && in->ip->type != T_DEV && out->type == FD_PIPE &&
+     !shmapped(in->ip)){
+    while(tot < n){
+      if(pipewait(out->pipe) < 0){
+        r = -1;
+        break;
+      }
+      ilock(in->ip);
+      r = 0;
+      eof = *off >= in->ip->size;
+      if(!eof && (r = sendi(in->ip, out->pipe, *off, n - tot)) > 0)
+        *off += r;
+      iunlock(in->ip);
+      if(eof || r < 0)
+        break;
+      tot += r;
+    }
+    return tot > 0 ? tot : r;
+  }
+
+  if((page = kalloc()) == 0)
+    return -1;
+  while(tot < n){
+    m = n - tot < PGSIZE ? n - tot : PGSIZE;
+    if(in->type == FD_PIPE)
+      r = piperead(in->pipe, page, m);
+    else
+      r = inoderead(in, page, m, off);
+    if(r <= 0)
+      break;
+    if(filewrite(out, page, r) != r){
+      r = -1;
+      break;
+    }
+    tot += r;
+    if(r < m)  // end of file, or all the pipe has for now
+      break;
+  }
+  kfree(page);
+  return tot > 0 ? tot : r;
+}
@@ -14,15 +14,27 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int text;           // imgsegs of running programs that hold it
+  int writers;        // open files that may write it
+  struct inode *hnext;  // hash chain
+  struct inode *lprev;  // LRU list of unreferenced inodes
+  struct inode *lnext;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint ralast;        // last block read, for read-ahead
+  uint ranext;        // next block to read ahead
+  uint rawin;         // read-ahead window, 0 if not sequential
+  uint leaf;          // last pointer block bmap() used, or 0
+  uint leafbase;      // first file block leaf maps
+  uint lastblk;       // last block allocated to the file, or 0
+  int lseq;           // log transaction that last changed it
 
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+3];
 };
 
 // table mapping major device number to
@@ -23,6 +23,8 @@
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void dinit(void);
+static void dpurge(struct inode*);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -51,28 +53,123 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
+//
+// The allocator keeps in memory a count of the free blocks under
+// each bitmap block, taken the first time it reads that block,
+// so that searches skip full bitmap blocks without reading them,
+// and it scans the bitmap a word at a time.  A search starts at
+// a goal, just past the block the file got last, so that appends
+// get contiguous runs.  A file's first block comes from the
+// next-fit hint, preferably at the start of a wholly free bitmap
+// word, so that files growing side by side do not interleave.
+
+#define BPW      32          // bitmap bits per word
+#define NOCOUNT  0xffffffff  // free blocks not yet counted
+
+struct {
+  struct spinlock lock;
+  uint *nfree;  // free blocks under each bitmap block, or NOCOUNT
+  uint next;    // next-fit hint for balloc()
+  uint inext;   // next-fit hint for ialloc()
+} fsalloc;
+
+// The bitmap word for blocks b..b+BPW-1 in bitmap block bp,
+// which starts at block base, with blocks past the end of the
+// disk marked in use.
+static uint
+bword(struct buf *bp, uint base, uint b)
+{
+  uint w;
+
+  w = ((uint*)bp->data)[(b - base) / BPW];
+  if(sb.size - b < BPW)
+    w |= ~0U << (sb.size - b);
+  return w;
+}
+
+static uint
+popcount(uint w)
+{
+  w = w - ((w >> 1) & 0x55555555);
+  w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+  return (((w + (w >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+// Count the free blocks in bitmap block bp.
+static uint
+bcount(struct buf *bp, uint base)
+{
+  uint b, n;
+
+  n = 0;
+  for(b = base; b < base + BPB && b < sb.size; b += BPW)
+    n += BPW - popcount(bword(bp, base, b));
+  return n;
+}
 
-// Allocate a zeroed disk block.
+// Find a free block at or after start in bitmap block bp; if
+// run, one that starts a free word.  Returns 0 if there is none.
 static uint
-balloc(uint dev)
+bscan(struct buf *bp, uint base, uint start, int run)
 {
-  int b, bi, m;
+  uint b, w;
+
+  for(b = start - (start - base) % BPW; b < base + BPB && b < sb.size; b += BPW){
+    w = bword(bp, base, b);
+    if(b < start)
+      w |= (1U << (start - b)) - 1;
+    if(run ? w == 0 : w != ~0U)
+      return b + __builtin_ctz(~w);
+  }
+  return 0;
+}
+
+// Allocate a zeroed disk block, as near after goal as possible,
+// or anywhere if goal is 0.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint b, bi, i, n, nbmap, start;
+  int run;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
+  nbmap = (sb.size + BPB - 1) / BPB;
+  acquire(&fsalloc.lock);
+  run = goal == 0 || goal >= sb.size;
+  start = run ? fsalloc.next : goal;
+  release(&fsalloc.lock);
+  if(start >= sb.size)
+    start = 0;
+
+  for(; run >= 0; run--){
+    // Visit every bitmap block from start's, and come back to
+    // start's for the blocks before start.
+    for(i = 0; i <= nbmap; i++){
+      bi = (start / BPB + i) % nbmap;
+      acquire(&fsalloc.lock);
+      n = fsalloc.nfree[bi];
+      release(&fsalloc.lock);
+      if(n == 0 || (run && n < BPW))
+        continue;
+      bp = bread(dev, BBLOCK(bi * BPB, sb));
+      acquire(&fsalloc.lock);
+      if(fsalloc.nfree[bi] == NOCOUNT)
+        fsalloc.nfree[bi] = bcount(bp, bi * BPB);
+      release(&fsalloc.lock);
+      b = bscan(bp, bi * BPB, i == 0 ? start : bi * BPB, run);
+      if(b != 0){
+        bp->data[(b % BPB)/8] |= 1 << (b % 8);  // Mark block in use.
         log_write(bp);
+        acquire(&fsalloc.lock);
+        fsalloc.nfree[bi]--;
+        fsalloc.next = b + 1;
+        release(&fsalloc.lock);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        bzero(dev, b);
+        return b;
       }
+      brelse(bp);
     }
-    brelse(bp);
   }
   panic("balloc: out of blocks");
 }
@@ -91,6 +188,10 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  acquire(&fsalloc.lock);
+  if(fsalloc.nfree[b / BPB] != NOCOUNT)
+    fsalloc.nfree[b / BPB]++;
+  release(&fsalloc.lock);
   brelse(bp);
 }
 
@@ -157,28 +258,97 @@ bfree(int dev, uint b)
 // The icache.lock spin-lock protects the allocation of icache
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// holds, one must hold icache.lock while using any of those fields,
+// or the hash chains and LRU list.
+//
+// The cache grows a page of entries at a time, up to
+// 1/ICACHEDIV of free memory, beyond which iget() recycles the
+// least recently used entry with no references.  Entries with no
+// references keep their contents, so getting one back again
+// needs no disk read.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 1021
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+  struct inode lru;  // unreferenced entries, most recently used first
+  int n;             // entries in the cache
+  int max;           // grow beyond this only if all are in use
 } icache;
 
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &icache.hash[(dev*31 + inum) % NIHASH];
+}
+
+// Put unreferenced ip on the LRU list: at the front if its
+// contents are worth keeping, else at the back, to be reused
+// first.  Caller holds icache.lock.
+static void
+ilru(struct inode *ip, int keep)
+{
+  struct inode *at;
+
+  at = keep ? &icache.lru : icache.lru.lprev;
+  ip->lnext = at->lnext;
+  ip->lprev = at;
+  at->lnext->lprev = ip;
+  at->lnext = ip;
+}
+
+static void
+iunlru(struct inode *ip)
+{
+  ip->lnext->lprev = ip->lprev;
+  ip->lprev->lnext = ip->lnext;
+}
+
+// Add a page of unused entries to the cache.
+// Caller holds icache.lock.
+static int
+igrow(void)
+{
+  struct inode *ip;
+  char *p;
+
+  if((p = kalloc()) == 0)
+    return -1;
+  memset(p, 0, PGSIZE);
+  for(ip = (struct inode*)p; ip+1 <= (struct inode*)(p+PGSIZE); ip++){
+    initsleeplock(&ip->lock, "inode");
+    ilru(ip, 0);
+    icache.n++;
+  }
+  return 0;
+}
+
 void
 iinit(int dev)
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  icache.lru.lprev = icache.lru.lnext = &icache.lru;
+  icache.max = kfreepages() / ICACHEDIV * (PGSIZE / sizeof(struct inode));
+  acquire(&icache.lock);
+  while(icache.n < NINODE)
+    if(igrow() < 0)
+      panic("iinit: no memory");
+  if(icache.max < icache.n)
+    icache.max = icache.n;
+  release(&icache.lock);
 
   readsb(dev, &sb);
+  dinit();
+  initlock(&fsalloc.lock, "fsalloc");
+  if((sb.size + BPB - 1) / BPB > PGSIZE / sizeof(uint) ||
+     (fsalloc.nfree = (uint*)kalloc()) == 0)
+    panic("iinit: fsalloc");
+  memset(fsalloc.nfree, 0xff, PGSIZE);  // NOCOUNT
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
           sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
@@ -194,20 +364,36 @@ static struct inode* iget(uint dev, uint inum);
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  uint inum, n;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
+  acquire(&fsalloc.lock);
+  inum = fsalloc.inext;
+  release(&fsalloc.lock);
+  if(inum >= sb.ninodes)
+    inum = 0;
+
+  // Look at each inode once, from the next-fit hint on,
+  // reading each inode block once.
+  for(n = 0; n < sb.ninodes; ){
     bp = bread(dev, IBLOCK(inum, sb));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
-    }
+    do {
+      dip = (struct dinode*)bp->data + inum%IPB;
+      if(inum > 0 && dip->type == 0){  // a free inode
+        memset(dip, 0, sizeof(*dip));
+        dip->type = type;
+        log_write(bp);   // mark it allocated on the disk
+        brelse(bp);
+        acquire(&fsalloc.lock);
+        fsalloc.inext = inum + 1;
+        release(&fsalloc.lock);
+        return iget(dev, inum);
+      }
+      n++;
+      if(++inum == sb.ninodes)
+        inum = 0;
+    } while(inum % IPB != 0 && n < sb.ninodes);
     brelse(bp);
   }
   panic("ialloc: no inodes");
@@ -233,6 +419,7 @@ iupdate(struct inode *ip)
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
+  ip->lseq = log_opseq();
 }
 
 // Find the inode with number inum on device dev
@@ -241,31 +428,51 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
+  int seq;
 
+  // An inode read in again may have been changed, before it left
+  // the cache, by any transaction up to the open one.
+  seq = log_opseq();
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = *ihash(dev, inum); ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        iunlru(ip);
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Recycle an inode cache entry: an unused one, else the least
+  // recently used, unless the cache may still grow.
+  ip = icache.lru.lprev;
+  if(ip == &icache.lru || (ip->inum != 0 && icache.n < icache.max))
+    if(igrow() == 0)
+      ip = icache.lru.lprev;
+  if(ip == &icache.lru)
     panic("iget: no inodes");
+  iunlru(ip);
+  if(ip->inum != 0){
+    for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+  }
 
-  ip = empty;
+  pp = ihash(dev, inum);
+  ip->hnext = *pp;
+  *pp = ip;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->ralast = 0;
+  ip->rawin = 0;
+  ip->leaf = 0;
+  ip->lastblk = 0;
+  ip->lseq = seq;
   release(&icache.lock);
 
   return ip;
@@ -282,6 +489,57 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Like idup(), for an imgseg of a running program, which reads
+// its pages from ip lazily: until iputtext(), writei() refuses
+// to change ip, so every page comes from the file exec() saw.
+// Returns 0 if ip is open for writing (see iwopen()).
+struct inode*
+itext(struct inode *ip)
+{
+  acquire(&icache.lock);
+  if(ip->writers > 0){
+    release(&icache.lock);
+    return 0;
+  }
+  ip->ref++;
+  ip->text++;
+  release(&icache.lock);
+  return ip;
+}
+
+void
+iputtext(struct inode *ip)
+{
+  acquire(&icache.lock);
+  ip->text--;
+  release(&icache.lock);
+  iput(ip);
+}
+
+// Note that a file open for writing refers to ip, which keeps
+// exec() from running it.  Returns -1 if ip is the file of a
+// running program, which cannot be opened for writing.
+int
+iwopen(struct inode *ip)
+{
+  acquire(&icache.lock);
+  if(ip->text > 0){
+    release(&icache.lock);
+    return -1;
+  }
+  ip->writers++;
+  release(&icache.lock);
+  return 0;
+}
+
+void
+iwclose(struct inode *ip)
+{
+  acquire(&icache.lock);
+  ip->writers--;
+  release(&icache.lock);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -338,6 +596,8 @@ iput(struct inode *ip)
     release(&icache.lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
+      if(ip->type == T_DIR)
+        dpurge(ip);
       itrunc(ip);
       ip->type = 0;
       iupdate(ip);
@@ -347,7 +607,8 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref == 0)
+    ilru(ip, ip->valid);
   release(&icache.lock);
 }
 
@@ -365,38 +626,96 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT], the NDINDIRECT after
+// those through the blocks listed in ip->addrs[NDIRECT+1],
+// and the NTINDIRECT after those through three levels of
+// pointer blocks under ip->addrs[NDIRECT+2].
+
+// Allocate a block for ip, just after the last one it got, or
+// else just after prev if that is not 0.
+static uint
+iballoc(struct inode *ip, uint prev)
+{
+  uint goal;
+
+  goal = ip->lastblk ? ip->lastblk : prev;
+  ip->lastblk = balloc(ip->dev, goal ? goal + 1 : 0);
+  return ip->lastblk;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
+  uint addr, *a, n, i, level, fbn;
   struct buf *bp;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = iballoc(ip, bn > 0 ? ip->addrs[bn-1] : 0);
     return addr;
   }
-  bn -= NDIRECT;
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+  fbn = bn;
+  if(ip->leaf && bn - ip->leafbase < NINDIRECT){
+    // Sequential access stays within one last-level pointer
+    // block for NINDIRECT blocks; skip the walk down to it.
+    addr = ip->leaf;
+    bn -= ip->leafbase;
+    level = 1;
+    n = NINDIRECT;
+  } else {
+    // Find the tree that maps bn, and bn's index within it.
+    bn -= NDIRECT;
+    for(level = 1, n = NINDIRECT; bn >= n; level++, n *= NINDIRECT){
+      if(level == 3)
+        panic("bmap: out of range");
+      bn -= n;
+    }
+    if((addr = ip->addrs[NDIRECT+level-1]) == 0)
+      ip->addrs[NDIRECT+level-1] = addr = iballoc(ip, 0);
+  }
+
+  // Load pointer blocks down the tree, allocating if necessary.
+  for(; level > 0; level--){
+    n /= NINDIRECT;  // blocks mapped by each entry at this level
+    if(level == 1){
+      ip->leaf = addr;
+      ip->leafbase = fbn - bn;
+    }
+    i = bn / n;
+    bn %= n;
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    if((addr = a[i]) == 0){
+      a[i] = addr = iballoc(ip, i > 0 ? a[i-1] : bp->blockno);
       log_write(bp);
     }
     brelse(bp);
-    return addr;
   }
+  return addr;
+}
 
-  panic("bmap: out of range");
+// Free block addr and, if it is a pointer block at the given
+// level of indirection, the blocks it points to.
+static void
+ifree(uint dev, uint addr, int level)
+{
+  int j;
+  struct buf *bp;
+  uint *a;
+
+  if(level > 0){
+    bp = bread(dev, addr);
+    a = (uint*)bp->data;
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j])
+        ifree(dev, a[j], level-1);
+    }
+    brelse(bp);
+  }
+  bfree(dev, addr);
 }
 
 // Truncate inode (discard contents).
@@ -407,28 +726,16 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
 
-  for(i = 0; i < NDIRECT; i++){
+  for(i = 0; i < NDIRECT+3; i++){
     if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
+      ifree(ip->dev, ip->addrs[i], i < NDIRECT ? 0 : i-NDIRECT+1);
       ip->addrs[i] = 0;
     }
   }
-
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
-  }
+  ip->leaf = 0;
+  ip->lastblk = 0;
 
   ip->size = 0;
   iupdate(ip);
@@ -447,6 +754,45 @@ stati(struct inode *ip, struct stat *st)
 }
 
 //PAGEBREAK!
+// Read ahead of a sequential reader of ip that is about to read
+// blocks first through last.  The window starts small and doubles
+// each time the reader catches up with half of it, up to MAXRA
+// blocks; any non-sequential read resets it.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint first, uint last)
+{
+  uint bn, end, nblocks;
+
+  if(first != 0 && first != ip->ralast && first != ip->ralast + 1){
+    ip->ralast = last;
+    ip->rawin = 0;
+    return;
+  }
+  ip->ralast = last;
+  if(ip->rawin == 0){
+    ip->rawin = 4;
+    ip->ranext = last + 1;
+  }
+  if(ip->ranext > last + 1 + ip->rawin/2)
+    return;
+  if(ip->ranext < last + 1)
+    ip->ranext = last + 1;
+
+  // Blocks below the end of the file are all allocated,
+  // so bmap() does not allocate here.
+  end = last + 1 + ip->rawin;
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  if(end > nblocks)
+    end = nblocks;
+  for(bn = ip->ranext; bn < end; bn++)
+    breada(ip->dev, bmap(ip, bn));
+  if(end > ip->ranext)
+    ip->ranext = end;
+  if(ip->rawin < MAXRA)
+    ip->rawin *= 2;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 int
@@ -465,6 +811,8 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     return -1;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(n > 0)
+    readahead(ip, off/BSIZE, (off + n - 1)/BSIZE);
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -472,6 +820,36 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
   }
+  shread(ip, dst - n, off - n, n);  // stores to shared mappings
+  return n;
+}
+
+// Copy data from inode into pipe p, straight out of the buffer
+// cache, until n bytes are done or p is full.
+// Caller must hold ip->lock.  Returns the number of bytes copied.
+int
+sendi(struct inode *ip, struct pipe *p, uint off, uint n)
+{
+  uint tot, m, k;
+  struct buf *bp;
+
+  if(ip->type == T_DEV)
+    return -1;
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+  if(n > 0)
+    readahead(ip, off/BSIZE, (off + n - 1)/BSIZE);
+
+  for(tot=0; tot<n; tot+=k, off+=k){
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    m = min(n - tot, BSIZE - off%BSIZE);
+    k = pipeput(p, (char*)bp->data + off%BSIZE, m);
+    brelse(bp);
+    if(k < m)
+      return tot + k;
+  }
   return n;
 }
 
@@ -490,9 +868,11 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return devsw[ip->major].write(ip, src, n);
   }
 
+  if(ip->text)
+    return -1;  // a running program's pages are read from it
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
+  if(n > 0 && (off + n - 1) / BSIZE >= MAXFILE)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
@@ -502,6 +882,8 @@ writei(struct inode *ip, char *src, uint off, uint n)
     log_write(bp);
     brelse(bp);
   }
+  shwrite(ip, src - n, off - n, n);  // into shared mappings
+  ip->lseq = log_opseq();
 
   if(n > 0 && off > ip->size){
     ip->size = off;
@@ -519,40 +901,464 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Read block bn of directory dp.
+static struct buf*
+dirblock(struct inode *dp, uint bn)
+{
+  return bread(dp->dev, bmap(dp, bn));
+}
+
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;  // FNV-1a
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// The index record of hashed directory block bp, or 0 if bp is
+// block 0 of a small directory.
+static struct dirindex*
+dirindex(struct buf *bp, int bn)
+{
+  struct dirindex *di;
+
+  di = (struct dirindex*)bp->data + (bn == 0 ? 2 : 0);
+  if(di->inum != 0 || di->magic != DIRMAGIC)
+    return 0;
+  return di;
+}
+
+// Entry i of the hash table in block 0 of a hashed directory.
+static ushort*
+dirtab(struct buf *bp0, uint i)
+{
+  return &((struct dirtab*)bp0->data + 3 + i/DIRTABPER)->blk[i%DIRTABPER];
+}
+
+// The block holding name's bucket, given block 0 of a hashed
+// directory.
+static uint
+dirbucket(struct buf *bp0, char *name)
+{
+  return *dirtab(bp0, dirhash(name) & ((1 << dirindex(bp0, 0)->depth) - 1));
+}
+
+// Index of the entry for name among entries from..n-1 of
+// directory block bp, or of the first free entry if name is 0.
+// Returns -1 if there is none.
+static int
+dirscan(struct buf *bp, int from, int n, char *name)
+{
+  struct dirent *de;
+  int i;
+
+  de = (struct dirent*)bp->data;
+  for(i = from; i < n; i++){
+    if(name == 0 ? de[i].inum == 0 : de[i].inum != 0 && namecmp(name, de[i].name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+// Directory entry cache: maps (directory, name) to the inode
+// number, or to 0 for a name known to be absent, so that
+// repeated lookups skip the directory's blocks.  Callers hold
+// the directory's lock, which orders its cache updates;
+// dirlink() and dirforget() update entries as names come and
+// go, and iput() drops a freed directory's entries.
+
+#define NDHASH 127
+
+struct dentry {
+  uint dev;
+  uint dir;             // directory's inum, 0 if unused
+  char name[DIRSIZ];
+  uint inum;            // 0 if name is not in dir
+  struct dentry *next;  // hash chain
+  struct dentry *lprev; // LRU list, most recent first
+  struct dentry *lnext;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDENTRY];
+  struct dentry *hash[NDHASH];
+  struct dentry lru;
+} dcache;
+
+static void
+dinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.lru.lprev = dcache.lru.lnext = &dcache.lru;
+  for(d = dcache.dentry; d < dcache.dentry+NDENTRY; d++){
+    d->lnext = dcache.lru.lnext;
+    d->lprev = &dcache.lru;
+    dcache.lru.lnext->lprev = d;
+    dcache.lru.lnext = d;
+  }
+}
+
+static struct dentry**
+dhash(uint dev, uint dir, char *name)
+{
+  return &dcache.hash[(dirhash(name) + dir*31 + dev) % NDHASH];
+}
+
+// Find (dev, dir, name); caller holds dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = *dhash(dev, dir, name); d; d = d->next)
+    if(d->dir == dir && d->dev == dev && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Take d off its hash chain; caller holds dcache.lock.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = dhash(d->dev, d->dir, d->name); *pp != d; pp = &(*pp)->next)
+    ;
+  *pp = d->next;
+  d->dir = 0;
+}
+
+// Move d to the front of the LRU list; caller holds dcache.lock.
+static void
+dtouch(struct dentry *d)
+{
+  d->lnext->lprev = d->lprev;
+  d->lprev->lnext = d->lnext;
+  d->lnext = dcache.lru.lnext;
+  d->lprev = &dcache.lru;
+  dcache.lru.lnext->lprev = d;
+  dcache.lru.lnext = d;
+}
+
+// Look name up in dp's cached entries.  Returns 1 and sets
+// *inum if there is an entry.
+static int
+dlookup(struct inode *dp, char *name, uint *inum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) != 0){
+    *inum = d->inum;
+    dtouch(d);
+  }
+  release(&dcache.lock);
+  return d != 0;
+}
+
+// Record that name in dp is inum, or is absent if inum is 0,
+// reusing the least recently used entry.
+static void
+dremember(struct inode *dp, char *name, uint inum)
+{
+  struct dentry *d, **h;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) == 0){
+    d = dcache.lru.lprev;
+    if(d->dir)
+      dunhash(d);
+    d->dev = dp->dev;
+    d->dir = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    h = dhash(d->dev, d->dir, name);
+    d->next = *h;
+    *h = d;
+  }
+  d->inum = inum;
+  dtouch(d);
+  release(&dcache.lock);
+}
+
+// Forget any cached entry for name in dp, which the caller is
+// unlinking.
+void
+dirforget(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) != 0)
+    dunhash(d);
+  release(&dcache.lock);
+}
+
+// Drop every entry for directory dp, which is being freed.
+static void
+dpurge(struct inode *dp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < dcache.dentry+NDENTRY; d++)
+    if(d->dir == dp->inum && d->dev == dp->dev)
+      dunhash(d);
+  release(&dcache.lock);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint bn, next, inum;
+  int i;
+  struct buf *bp;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
+  if(dp->size == 0)
+    return 0;
+  if(poff == 0 && dlookup(dp, name, &inum))
+    return inum ? iget(dp->dev, inum) : 0;
+
+  // Block 0 holds ".", ".." and, in a small directory,
+  // everything else; in a hashed one, look in name's bucket
+  // and its overflow blocks.
+  bn = 0;
+  bp = dirblock(dp, 0);
+  i = dirscan(bp, 0, min(dp->size, BSIZE) / sizeof(struct dirent), name);
+  if(i < 0 && dirindex(bp, 0)){
+    next = dirbucket(bp, name);
+    while(i < 0 && next != 0){
+      brelse(bp);
+      bn = next;
+      bp = dirblock(dp, bn);
+      i = dirscan(bp, 1, DPB, name);
+      next = dirindex(bp, bn)->next;
+    }
+  }
+  if(i < 0){
+    brelse(bp);
+    dremember(dp, name, 0);
+    return 0;
+  }
+  // entry matches path element
+  if(poff)
+    *poff = bn*BSIZE + i*sizeof(struct dirent);
+  inum = ((struct dirent*)bp->data)[i].inum;
+  brelse(bp);
+  dremember(dp, name, inum);
+  return iget(dp->dev, inum);
+}
+
+// Start a bucket with hash depth depth in block bp.
+static void
+dirinitbucket(struct buf *bp, int depth)
+{
+  struct dirindex *di;
+
+  di = (struct dirindex*)bp->data;
+  memset(di, 0, sizeof(*di));
+  di->magic = DIRMAGIC;
+  di->depth = depth;
+}
+
+// Add a new bucket to hashed directory dp.
+static struct buf*
+dirnewbucket(struct inode *dp, int depth)
+{
+  struct buf *bp;
+
+  bp = dirblock(dp, dp->size / BSIZE);
+  dp->size += BSIZE;
+  iupdate(dp);
+  dirinitbucket(bp, depth);
+  return bp;
+}
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
+// Move the entries from index first on in block src whose hash
+// has bit bit equal to val into bucket dst.
+static void
+dirmove(struct buf *src, int first, int bit, int val, struct buf *dst)
+{
+  struct dirent *de;
+  int i, j;
+
+  de = (struct dirent*)src->data;
+  j = 1;
+  for(i = first; i < DPB; i++){
+    if(de[i].inum == 0 || ((dirhash(de[i].name) >> bit) & 1) != val)
       continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+    j = dirscan(dst, j, DPB, 0);
+    ((struct dirent*)dst->data)[j] = de[i];
+    memset(&de[i], 0, sizeof(de[i]));
+  }
+}
+
+// Turn small directory dp, whose block 0 bp0 is full, into a
+// hashed directory with two buckets.
+static void
+dirhashify(struct inode *dp, struct buf *bp0)
+{
+  struct buf *b1, *b2;
+  struct dirindex *di;
+
+  b1 = dirnewbucket(dp, 1);
+  b2 = dirnewbucket(dp, 1);
+  dirmove(bp0, 2, 0, 0, b1);
+  dirmove(bp0, 2, 0, 1, b2);
+  di = (struct dirindex*)bp0->data + 2;
+  di->magic = DIRMAGIC;
+  di->depth = 1;
+  *dirtab(bp0, 0) = 1;
+  *dirtab(bp0, 1) = 2;
+  log_write(b1);
+  log_write(b2);
+  log_write(bp0);
+  brelse(b1);
+  brelse(b2);
+}
+
+// Split full bucket bn, in block bp, of hashed directory dp,
+// whose block 0 is bp0, on the next hash bit, doubling the
+// hash table if necessary.  A half that gets no names gets no
+// block either: its table entries become 0.
+static void
+dirsplit(struct inode *dp, struct buf *bp0, struct buf *bp, uint bn)
+{
+  struct dirindex *d0, *di;
+  struct dirent *de;
+  struct buf *nbp;
+  uint j, nb;
+  int depth, i, n, ones, keep;
+
+  d0 = dirindex(bp0, 0);
+  di = dirindex(bp, bn);
+  depth = di->depth;
+  if(depth == d0->depth){
+    for(j = 0; j < (1 << d0->depth); j++)
+      *dirtab(bp0, j + (1 << d0->depth)) = *dirtab(bp0, j);
+    d0->depth++;
+  }
+  di->depth = depth + 1;
+
+  de = (struct dirent*)bp->data;
+  n = ones = 0;
+  for(i = 1; i < DPB; i++){
+    if(de[i].inum != 0){
+      n++;
+      ones += (dirhash(de[i].name) >> depth) & 1;
     }
   }
 
-  return 0;
+  // bp keeps the half with bit depth equal to keep.
+  keep = ones == n;
+  nb = 0;
+  if(ones > 0 && ones < n){
+    nb = dp->size / BSIZE;
+    nbp = dirnewbucket(dp, depth + 1);
+    dirmove(bp, 1, depth, 1, nbp);
+    log_write(nbp);
+    brelse(nbp);
+  }
+  for(j = 0; j < (1 << d0->depth); j++){
+    if(*dirtab(bp0, j) == bn && ((j >> depth) & 1) != keep)
+      *dirtab(bp0, j) = nb;
+  }
+  log_write(bp);
+  log_write(bp0);
+}
+
+// Give hash table entry h of hashed directory dp, whose block 0
+// is bp0 and which has no bucket, a new empty bucket, shared by
+// as many of the other entries without one as agree with h in
+// its low bits.  Returns the bucket's block.
+static uint
+dirfill(struct inode *dp, struct buf *bp0, uint h)
+{
+  struct buf *bp;
+  uint j, nb, size;
+  int depth;
+
+  size = 1 << dirindex(bp0, 0)->depth;
+  for(depth = 0; ; depth++){
+    for(j = h & ((1 << depth) - 1); j < size; j += 1 << depth)
+      if(*dirtab(bp0, j) != 0)
+        break;
+    if(j >= size)
+      break;
+  }
+  nb = dp->size / BSIZE;
+  bp = dirnewbucket(dp, depth);
+  for(j = h & ((1 << depth) - 1); j < size; j += 1 << depth)
+    *dirtab(bp0, j) = nb;
+  log_write(bp);
+  log_write(bp0);
+  brelse(bp);
+  return nb;
+}
+
+// Return the block of hashed directory dp, whose block 0 is bp0,
+// with a free entry for name, which may be a new block.
+// Splits name's bucket until it has room, or if it cannot be
+// split, adds an overflow block.  Adds at most one block.
+static struct buf*
+dirfree(struct inode *dp, struct buf *bp0, char *name)
+{
+  struct dirindex *d0, *di;
+  struct buf *bp;
+  uint bn, h;
+
+  d0 = dirindex(bp0, 0);
+  for(;;){
+    h = dirhash(name) & ((1 << d0->depth) - 1);
+    if((bn = *dirtab(bp0, h)) == 0)
+      bn = dirfill(dp, bp0, h);
+    bp = dirblock(dp, bn);
+    if(dirscan(bp, 1, DPB, 0) >= 0)
+      break;
+    if(dirindex(bp, bn)->depth == DIRMAXDEPTH){
+      while(dirscan(bp, 1, DPB, 0) < 0){
+        di = dirindex(bp, bn);
+        if(di->next == 0){
+          di->next = dp->size / BSIZE;
+          log_write(bp);
+          brelse(bp);
+          bn = dp->size / BSIZE;
+          bp = dirnewbucket(dp, DIRMAXDEPTH);
+        } else {
+          bn = di->next;
+          brelse(bp);
+          bp = dirblock(dp, bn);
+        }
+      }
+      break;
+    }
+    dirsplit(dp, bp0, bp, bn);
+    brelse(bp);
+  }
+  return bp;
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
+// Returns -1 if name is already present.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
-  struct dirent de;
+  int i;
+  struct dirent *de, nde;
+  struct buf *bp0, *bp;
   struct inode *ip;
 
   // Check that name is not present.
@@ -561,19 +1367,37 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  memset(&nde, 0, sizeof(nde));
+  strncpy(nde.name, name, DIRSIZ);
+  nde.inum = inum;
+
+  bp0 = bp = dirblock(dp, 0);
+  if(dirindex(bp0, 0) == 0){
+    // Small directory: look for an empty dirent, else append
+    // one, until it fills block 0.
+    i = dirscan(bp0, 0, min(dp->size, BSIZE) / sizeof(struct dirent), 0);
+    if(i < 0 && dp->size < BSIZE){
+      brelse(bp0);
+      if(writei(dp, (char*)&nde, dp->size, sizeof(nde)) != sizeof(nde))
+        panic("dirlink");
+      dremember(dp, name, inum);
+      return 0;
+    }
+    if(i < 0)
+      dirhashify(dp, bp0);
+  }
+  if(dirindex(bp0, 0)){
+    bp = dirfree(dp, bp0, name);
+    i = dirscan(bp, 1, DPB, 0);
   }
 
-  strncpy(de.name, name, DIRSIZ);
-  de.inum = inum;
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("dirlink");
-
+  de = (struct dirent*)bp->data + i;
+  *de = nde;
+  log_write(bp);
+  dremember(dp, name, inum);
+  if(bp != bp0)
+    brelse(bp);
+  brelse(bp0);
   return 0;
 }
 
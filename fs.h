@@ -3,7 +3,7 @@
 
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+#define BSIZE 4096  // block size
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
@@ -21,9 +21,17 @@ struct superblock {
   uint bmapstart;    // Block number of first free map block
 };
 
-#define NDIRECT 12
+// Most blocks the log header can list: it holds a count, a
+// checksum, and the block numbers.
+#define LOGMAX (BSIZE / sizeof(uint) - 2)
+
+// A file's first NDIRECT blocks are listed in the inode; the
+// rest through a single, a double and a triple indirect block.
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NDINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -32,7 +40,7 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+3];   // Data block addresses
 };
 
 // Inodes per block.
@@ -55,3 +63,33 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Directory entries per block.
+#define DPB           (BSIZE / sizeof(struct dirent))
+
+// A directory larger than one block is hashed.  Block 0 holds
+// ".", "..", a dirindex, and then a table of dirtabs mapping
+// the low depth bits of a name's hash to the directory block
+// holding the name's bucket.  Each other block is a bucket,
+// starting with a dirindex whose depth says how many hash bits
+// its names share.  A table entry is 0 if no name has needed
+// its bucket yet.  A bucket that is full at DIRMAXDEPTH, whose
+// names all share that many hash bits, chains to overflow
+// blocks through next.  Index records have inum 0, so they read
+// as free entries to code that does not know about the index.
+#define DIRMAGIC      0x6864
+#define DIRTABPER     7   // table entries per dirtab
+#define DIRMAXDEPTH   10  // (DPB-3)*DIRTABPER >= 1<<DIRMAXDEPTH
+
+struct dirindex {
+  ushort inum;          // always 0
+  ushort magic;         // DIRMAGIC
+  ushort depth;         // hash bits in use
+  ushort next;          // overflow block of this bucket, or 0
+  ushort pad[4];
+};
+
+struct dirtab {
+  ushort inum;          // always 0
+  ushort blk[DIRTABPER];
+};
+
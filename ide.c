@@ -1,4 +1,5 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// IDE driver code.  Uses bus-master DMA when the controller
+// supports it (the PIIX that QEMU emulates does), else PIO.
 
 #include "types.h"
 #include "defs.h"
@@ -12,6 +13,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "pci.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -23,16 +25,52 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_IDENT 0xec
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
-// You must hold idelock while manipulating queue.
+// Bus-master registers, at offsets from bmbase.
+#define BM_CMD        0
+#define BM_STATUS     2
+#define BM_PRDT       4
+#define BM_START      0x1   // in BM_CMD
+#define BM_READ       0x8   // in BM_CMD: device to memory
+#define BM_ERR        0x2   // in BM_STATUS
+#define BM_INTR       0x4   // in BM_STATUS
+
+// Physical region descriptor: one contiguous piece of memory
+// for a DMA transfer.
+struct prd {
+  uint addr;
+  ushort len;
+  ushort flags;
+};
+#define PRD_EOT       0x8000  // last descriptor in the table
+
+#define MAXSECT       256  // most sectors one command can transfer
+#define MAXMULT        16  // sectors per interrupt to ask for
+
+// The active request is one disk command that transfers nsect
+// sectors for the nbuf bufs in reqbuf[], which hold consecutive
+// blocks.  Requests waiting for the disk are held by the I/O
+// scheduler (iosched.c), which chooses the order they are served in.
+// You must hold idelock while manipulating either.
 
 static struct spinlock idelock;
-static struct buf *idequeue;
+static struct buf *reqbuf[MAXSECT];
+static int nbuf;       // bufs in the active request, 0 if idle
+static int ndone;      // of which completed
+static int nsect;      // sectors in the active request
+static int sectdone;   // of which transferred
+static int multcnt[2]; // sectors per interrupt, for each disk
+static uint nblock[2]; // size of each disk, in blocks
+
+static int bmbase;     // bus-master I/O ports, 0 for PIO
+static struct prd *prdt;  // DMA descriptors for the active request
 
 static int havedisk1;
-static void idestart(struct buf*);
+static void idestart(void);
 
 // Wait for IDE disk to become ready.
 static int
@@ -47,6 +85,37 @@ idewait(int checkerr)
   return 0;
 }
 
+// Ask disk d to interrupt once per MAXMULT sectors, rather
+// than once per sector, during multi-sector transfers.
+static void
+idesetmult(int d)
+{
+  outb(0x1f2, MAXMULT);
+  outb(0x1f6, 0xe0 | (d<<4));
+  outb(0x1f7, IDE_CMD_SETMUL);
+  multcnt[d] = idewait(1) < 0 ? 1 : MAXMULT;
+}
+
+// Ask disk d for its size.  The file system's size is set when
+// mkfs makes the image, so the disk, not the kernel, knows it.
+// A disk that cannot say is not bounded at all, as before.
+static void
+idesize(int d)
+{
+  uint id[128];
+
+  nblock[d] = ~0;
+  outb(0x1f6, 0xe0 | (d<<4));
+  outb(0x1f7, IDE_CMD_IDENT);
+  if(idewait(1) < 0){
+    cprintf("ide: disk %d: size unknown\n", d);
+    return;
+  }
+  insl(0x1f0, id, 128);
+  if(id[30] != 0)
+    nblock[d] = id[30] / (BSIZE/SECTOR_SIZE);  // words 60-61: LBA28 sectors
+}
+
 void
 ideinit(void)
 {
@@ -65,104 +134,174 @@ ideinit(void)
     }
   }
 
+  idesetmult(0);
+  idesize(0);
+  if(havedisk1){
+    idesetmult(1);
+    idesize(1);
+  }
+
+  // Use DMA if the controller can master the bus.
+  if((i = pcifindclass(1, 1)) >= 0 && (pciread(i, PCI_CLASS) & 0x8000) &&
+     (pciread(i, PCI_BAR4) & 1) && (prdt = (struct prd*)kalloc()) != 0){
+    pcimaster(i);
+    bmbase = pciread(i, PCI_BAR4) & 0xfffc;
+  }
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Move the next chunk of the active request, at most one
+// interrupt's worth of sectors, between the disk and the bufs.
+static void
+idepio(int write)
+{
+  int spb, n, s;
+  uchar *p;
+
+  spb = BSIZE/SECTOR_SIZE;
+  n = nsect - sectdone;
+  if(n > multcnt[reqbuf[0]->dev&1])
+    n = multcnt[reqbuf[0]->dev&1];
+  for(s = sectdone; s < sectdone + n; s++){
+    p = reqbuf[s/spb]->data + (s%spb)*SECTOR_SIZE;
+    if(write)
+      outsl(0x1f0, p, SECTOR_SIZE/4);
+    else
+      insl(0x1f0, p, SECTOR_SIZE/4);
+  }
+  sectdone += n;
+}
+
+// Start the request at the head of the scheduler's queue, along
+// with any queued requests for the blocks that follow it in the
+// same direction, as one command.  Caller must hold idelock.
 static void
-idestart(struct buf *b)
+idestart(void)
 {
-  if(b == 0)
-    panic("idestart");
-  if(b->blockno >= FSSIZE)
+  struct buf *b;
+  int i, spb, sector, write, cmd;
+
+  if((b = iosched_next()) == 0){
+    nbuf = 0;
+    return;
+  }
+  if(b->blockno >= nblock[b->dev&1])
     panic("incorrect blockno");
-  int sector_per_block =  BSIZE/SECTOR_SIZE;
-  int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  spb = BSIZE/SECTOR_SIZE;
+  write = b->flags & B_DIRTY;
 
-  if (sector_per_block > 7) panic("idestart");
+  reqbuf[0] = b;
+  nbuf = 1;
+  while(nbuf < MAXSECT/spb && b->blockno + nbuf < nblock[b->dev&1] &&
+        (reqbuf[nbuf] = iosched_take(b->dev, b->blockno + nbuf, write)) != 0)
+    nbuf++;
+  ndone = 0;
+  nsect = nbuf * spb;
+  sectdone = 0;
+
+  sector = b->blockno * spb;
+  if(bmbase){
+    // Point the controller at the bufs' physical memory.
+    for(i = 0; i < nbuf; i++){
+      prdt[i].addr = V2P(reqbuf[i]->data);
+      prdt[i].len = BSIZE;
+      prdt[i].flags = i == nbuf-1 ? PRD_EOT : 0;
+    }
+    outl(bmbase+BM_PRDT, V2P(prdt));
+    outb(bmbase+BM_CMD, write ? 0 : BM_READ);
+    outb(bmbase+BM_STATUS, BM_ERR|BM_INTR);  // clear
+    cmd = write ? IDE_CMD_WRDMA : IDE_CMD_RDDMA;
+  } else if(multcnt[b->dev&1] > 1)
+    cmd = write ? IDE_CMD_WRMUL : IDE_CMD_RDMUL;
+  else
+    cmd = write ? IDE_CMD_WRITE : IDE_CMD_READ;
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, nsect & 0xff);  // number of sectors, 0 means 256
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
-  } else {
-    outb(0x1f7, read_cmd);
-  }
+  outb(0x1f7, cmd);
+  if(bmbase)
+    outb(bmbase+BM_CMD, (write ? 0 : BM_READ) | BM_START);
+  else if(write)
+    idepio(1);
 }
 
 // Interrupt handler.
+// With DMA the disk interrupts once, when the whole request is
+// done.  With PIO it interrupts once per chunk of sectors: for a
+// read when a chunk is ready, for a write when it has taken one.
 void
 ideintr(void)
 {
-  struct buf *b;
+  int write, spb;
 
-  // First queued buffer is the active request.
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if(nbuf == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
+  spb = BSIZE/SECTOR_SIZE;
+  write = reqbuf[0]->flags & B_DIRTY;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  if(bmbase){
+    // The whole transfer is done; stop the engine.
+    outb(bmbase+BM_CMD, 0);
+    outb(bmbase+BM_STATUS, BM_ERR|BM_INTR);
+    idewait(1);
+    sectdone = nsect;
+  } else if(write){
+    if(sectdone < nsect){
+      // Send the next chunk.
+      idepio(1);
+      release(&idelock);
+      return;
+    }
+  } else {
+    // Read data if needed.
+    if(idewait(1) >= 0)
+      idepio(0);
+    else
+      sectdone = nsect;
+  }
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  // Mark completed bufs done and wake processes waiting for them.
+  for(; ndone < nbuf && (write || (ndone+1)*spb <= sectdone); ndone++)
+    biodone(reqbuf[ndone]);
 
   // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  if(ndone == nbuf)
+    idestart();
 
   release(&idelock);
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
+// Queue b to be synced with disk and start the disk if it is
+// idle.  Does not wait: ideintr() calls biodone() when the
+// request has finished.
+// If B_DIRTY is set, write buf to disk, else read it.
 void
-iderw(struct buf *b)
+idesubmit(struct buf *b)
 {
-  struct buf **pp;
-
-  if(!holdingsleep(&b->lock))
-    panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("iderw: nothing to do");
+    panic("idesubmit: nothing to do");
   if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
+    panic("idesubmit: ide disk 1 not present");
 
   acquire(&idelock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
+  iosched_add(b);  //DOC:insert-queue
 
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
-
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
-  }
-
+  if(nbuf == 0)
+    idestart();
 
   release(&idelock);
 }
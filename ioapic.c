@@ -73,3 +73,21 @@ ioapicenable(int irq, int cpunum)
   ioapicwrite(REG_TABLE+2*irq, T_IRQ0 + irq);
   ioapicwrite(REG_TABLE+2*irq+1, cpunum << 24);
 }
+
+// Route the interrupt of a PCI device, whose irq is assigned by
+// the BIOS, to vector vec on cpunum, so that the device can use
+// the vector of the legacy device it stands in for.
+//
+// PCI INTx is level-triggered, so the interrupt stays pending
+// until the driver has acknowledged the device, however late.
+// On the bus the line is active low, but on the PC chipsets
+// QEMU models, where it reaches the I/O APIC through the
+// PIIX PIRQ router on an ISA irq, it is active high: that is
+// what the BIOS's interrupt source overrides say.  Other
+// hardware may need the polarity from its ACPI tables.
+void
+ioapicroute(int irq, int vec, int cpunum)
+{
+  ioapicwrite(REG_TABLE+2*irq, INT_LEVEL | vec);
+  ioapicwrite(REG_TABLE+2*irq+1, cpunum << 24);
+}
@@ -0,0 +1,206 @@
+// Disk I/O scheduling.
+//
+// The disk driver hands each request to iosched_add() and, when
+// the disk is idle, asks iosched_next() which request to start.
+// The driver's lock protects the scheduler's queues.
+//
+// Two policies are provided; IOSCHED in param.h picks one:
+// * fifo: requests are served in arrival order.
+// * cscan: a circular elevator.  Requests are kept sorted by
+//     device and block number and served in increasing order
+//     from the last request started, wrapping around to the
+//     lowest at the end, so that adjacent blocks go to the
+//     disk back to back.  To bound starvation, a request that
+//     has waited longer than its deadline is served first.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "iostat.h"
+
+#define READEXPIRE   10  // deadline for reads, in ticks
+#define WRITEEXPIRE 100  // deadline for writes, in ticks
+
+struct iosched {
+  char *name;
+  void (*add)(struct buf*);
+  struct buf *(*next)(void);
+};
+
+// Requests in arrival order, through fnext.
+static struct buf *fifo;
+// Requests sorted by device and block number, through qnext
+// (cscan only).
+static struct buf *sorted;
+
+static uint lastdev;     // device of the last request started
+static uint lastblock;   // block of the last request started
+static uint seek;        // total distance moved, in blocks
+static uint nmerge;      // requests taken by iosched_take()
+
+static void
+fifo_append(struct buf *b)
+{
+  struct buf **pp;
+
+  b->fnext = 0;
+  for(pp = &fifo; *pp; pp = &(*pp)->fnext)
+    ;
+  *pp = b;
+}
+
+static void
+fifo_remove(struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &fifo; *pp != b; pp = &(*pp)->fnext)
+    ;
+  *pp = b->fnext;
+}
+
+static void
+fifo_add(struct buf *b)
+{
+  fifo_append(b);
+}
+
+static struct buf*
+fifo_next(void)
+{
+  struct buf *b;
+
+  if((b = fifo) != 0)
+    fifo = b->fnext;
+  return b;
+}
+
+// Does block b1 of device d1 come before block b2 of d2 in
+// C-SCAN order?
+static int
+before(uint d1, uint b1, uint d2, uint b2)
+{
+  return d1 < d2 || (d1 == d2 && b1 < b2);
+}
+
+static void
+cscan_add(struct buf *b)
+{
+  struct buf **pp;
+
+  fifo_append(b);
+  for(pp = &sorted; *pp && !before(b->dev, b->blockno, (*pp)->dev, (*pp)->blockno); pp = &(*pp)->qnext)
+    ;
+  b->qnext = *pp;
+  *pp = b;
+}
+
+static struct buf*
+cscan_next(void)
+{
+  struct buf *b, **pp;
+  uint expire;
+
+  if(sorted == 0)
+    return 0;
+
+  // Oldest request past its deadline?
+  b = fifo;
+  expire = (b->flags & B_DIRTY) ? WRITEEXPIRE : READEXPIRE;
+  if(ticks - b->qtime < expire){
+    // No: next block at or after the head, else wrap around.
+    for(b = sorted; b && before(b->dev, b->blockno, lastdev, lastblock); b = b->qnext)
+      ;
+    if(b == 0)
+      b = sorted;
+  }
+
+  for(pp = &sorted; *pp != b; pp = &(*pp)->qnext)
+    ;
+  *pp = b->qnext;
+  fifo_remove(b);
+  return b;
+}
+
+static struct iosched scheds[] = {
+  { "fifo",  fifo_add,  fifo_next },
+  { "cscan", cscan_add, cscan_next },
+};
+
+// The policy in use.
+static struct iosched *policy;
+
+// Choose the policy named by IOSCHED.  Must be called before
+// the disk driver starts.
+void
+ioschedinit(void)
+{
+  for(policy = scheds; policy < &scheds[NELEM(scheds)]; policy++)
+    if(strncmp(policy->name, IOSCHED, 16) == 0)
+      return;
+  panic("ioschedinit: unknown IOSCHED");
+}
+
+// Queue request b.  Caller holds the driver's lock.
+void
+iosched_add(struct buf *b)
+{
+  policy->add(b);
+}
+
+// Remove and return the request to start next, or 0 if there
+// are none.  Caller holds the driver's lock.
+struct buf*
+iosched_next(void)
+{
+  struct buf *b;
+
+  if((b = policy->next()) != 0){
+    if(b->dev == lastdev)
+      seek += b->blockno > lastblock ? b->blockno - lastblock : lastblock - b->blockno;
+    lastdev = b->dev;
+    lastblock = b->blockno;
+  }
+  return b;
+}
+
+// Remove and return a queued request for block blockno of
+// device dev in the given direction (B_DIRTY set or not), so
+// that the driver can add it to the request it is starting.
+// Returns 0 if there is none.  Caller holds the driver's lock.
+struct buf*
+iosched_take(uint dev, uint blockno, int dirty)
+{
+  struct buf *b, **pp;
+
+  for(b = fifo; b; b = b->fnext)
+    if(b->dev == dev && b->blockno == blockno &&
+       (b->flags & B_DIRTY) == dirty)
+      break;
+  if(b == 0)
+    return 0;
+  fifo_remove(b);
+  for(pp = &sorted; *pp; pp = &(*pp)->qnext){
+    if(*pp == b){
+      *pp = b->qnext;
+      break;
+    }
+  }
+  lastdev = dev;
+  lastblock = blockno;
+  nmerge++;
+  return b;
+}
+
+// Report scheduler statistics.  The counters are read without
+// the driver's lock, so they may be slightly stale.
+void
+iosched_stat(struct iostat *st)
+{
+  st->seek = seek;
+  st->nmerge = nmerge;
+}
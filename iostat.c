@@ -0,0 +1,23 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "iostat.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct iostat st;
+
+  if(iostat(&st) < 0){
+    printf(2, "iostat: failed\n");
+    exit();
+  }
+  printf(1, "buffers %d (hot %d)\n", st.nbuf, st.nhot);
+  printf(1, "hits %d misses %d\n", st.hits, st.misses);
+  printf(1, "requests %d latency avg %d max %d ticks\n", st.nreq,
+         st.nreq ? st.lat / st.nreq : 0, st.latmax);
+  printf(1, "seek %d blocks\n", st.seek);
+  printf(1, "merged %d\n", st.nmerge);
+  printf(1, "commits %d installed %d\n", st.ncommit, st.ninstall);
+  exit();
+}
@@ -0,0 +1,13 @@
+struct iostat {
+  uint nbuf;    // buffers in the block cache
+  uint nhot;    // of which on the hot queue
+  uint hits;    // block lookups satisfied by the cache
+  uint misses;  // block lookups that recycled a buffer
+  uint nreq;    // disk requests completed
+  uint lat;     // total latency of those requests, in ticks
+  uint latmax;  // longest latency of a request, in ticks
+  uint seek;    // total distance between requests, in blocks
+  uint nmerge;  // requests merged into another's disk command
+  uint ncommit; // log transactions made durable
+  uint ninstall; // logged blocks written home
+};
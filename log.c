@@ -1,124 +1,237 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "iostat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
-// write an uncommitted system call's updates to disk.
+// calls. It is committed when it is closed -- because the log is
+// running out of space, FLUSHTICKS have passed, or a process
+// called sync() -- and no FS system calls are active in it. Thus
+// there is never any reasoning required about whether a commit
+// might write an uncommitted system call's updates to disk, and
+// FS system calls do not wait for the disk.
+//
+// Transactions are double-buffered. A commit first copies the
+// transaction's blocks out of the buffer cache into the log's
+// own shadow buffers; only during that copy are new FS system
+// calls held off. While the commit writes the copies to the log,
+// new FS system calls join the next open transaction, which is
+// committed as a group as soon as the current commit is done.
+//
+// Committed blocks are not written to their home locations right
+// away. Successive transactions are appended to the log, and the
+// blocks stay pinned in the buffer cache. Only when the log is
+// full, or the flusher thread finds it half full, are they
+// checkpointed: the latest copy of each block is written home
+// once, however many transactions logged it.
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// closes the open transaction and sleeps until it has been
+// committed.
 //
 // The log is a physical re-do log containing disk blocks.
+// Its size is set by mkfs and read from the superblock.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
+//     and a checksum of the block #s and the logged blocks
 //   block A
 //   block B
 //   block C
 //   ...
+// A block # may appear more than once; the last copy wins.
+// A commit appends its blocks after those already in the log,
+// then writes the header; the header write alone commits it.
+// Recovery replays the log only if the checksum matches, so the
+// header of a checkpointed log can be left in place, and a
+// half-written successor is ignored.
 // Log appends are synchronous.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  uint cksum;
+  int block[LOGMAX];
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // capacity in blocks, not counting the header
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int committing;  // someone is in commit().
+  int closing;     // the open transaction is to be committed; new ops must wait.
+  int copying;     // commit() is copying blocks; new ops must wait.
+  int seq;         // transactions taken for commit
+  int done;        // of those, how many are durable
+  uint ninstall;   // logged blocks written home
   int dev;
-  struct logheader lh;
+  struct logheader lh;  // the open transaction
+
+  // Used only by the committing process.
+  struct logheader clh;       // committed blocks not yet checkpointed
+  uint crc;                   // running checksum of clh
+  struct buf shadow[LOGMAX];  // copies of its blocks
 };
 struct log log;
 
+static uint crctab[256];
+
 static void recover_from_log(void);
 static void commit();
+static void flusher(void);
 
 void
 initlog(int dev)
 {
-  if (sizeof(struct logheader) >= BSIZE)
+  int i;
+  char *mem;
+
+  if (sizeof(struct logheader) > BSIZE)
     panic("initlog: too big logheader");
 
   struct superblock sb;
   initlock(&log.lock, "log");
   readsb(dev, &sb);
   log.start = sb.logstart;
-  log.size = sb.nlog;
+  log.size = sb.nlog - 1;
   log.dev = dev;
+  if (log.size < MAXOPBLOCKS || log.size > LOGMAX)
+    panic("initlog: bad log size");
+  mem = 0;
+  for (i = 0; i < log.size; i++) {
+    if ((uint)mem % PGSIZE == 0 && (mem = kalloc()) == 0)
+      panic("initlog: out of memory");
+    initsleeplock(&log.shadow[i].lock, "shadow");
+    log.shadow[i].dev = dev;
+    log.shadow[i].data = (uchar*)mem;
+    mem += BSIZE;
+  }
+  for (i = 0; i < 256; i++) {
+    uint c = i;
+    int k;
+    for (k = 0; k < 8; k++)
+      c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    crctab[i] = c;
+  }
   recover_from_log();
+  kthread("flusher", flusher);
 }
 
-// Copy committed blocks from log to their home location
-static void
-install_trans(void)
+static uint
+crc32(uint crc, void *p, int n)
+{
+  uchar *s = p;
+
+  while (n-- > 0)
+    crc = crctab[(crc ^ *s++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+// Extend crc over log slots from..log.clh.n-1: the block # and
+// the shadow copy of each.
+static uint
+cksum_slots(uint crc, int from)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
+  for (tail = from; tail < log.clh.n; tail++) {
+    crc = crc32(crc, &log.clh.block[tail], sizeof(log.clh.block[0]));
+    crc = crc32(crc, log.shadow[tail].data, BSIZE);
   }
+  return crc;
 }
 
-// Read the log header from disk into the in-memory log header
+// Read the log header from disk into log.clh.
 static void
 read_head(void)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  log.clh.n = lh->n;
+  log.clh.cksum = lh->cksum;
+  if (log.clh.n < 0 || log.clh.n > log.size)
+    log.clh.n = 0;  // garbage; the checksum will not match
+  for (i = 0; i < log.clh.n; i++) {
+    log.clh.block[i] = lh->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
+// Write log header lh to disk.
 // This is the true point at which the
-// current transaction commits.
+// transaction commits.
 static void
-write_head(void)
+write_head(struct logheader *lh)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  hb->cksum = lh->cksum;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
   bwrite(buf);
   brelse(buf);
 }
 
+static int write_shadows(int, int);
+
+// Replay the log, if its blocks are intact.  This redoes a
+// checkpointed log when it has not been reused since, which is
+// harmless.
 static void
 recover_from_log(void)
 {
+  int tail;
+  struct buf *b;
+
   read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  if (log.clh.n == 0)
+    return;
+
+  // Read the log into the shadows: all the reads, then the waits.
+  for (tail = 0; tail < log.clh.n; tail++) {
+    b = &log.shadow[tail];
+    acquiresleep(&b->lock);
+    b->blockno = log.start+tail+1;
+    b->flags = 0;
+    bio_submit(b, 0);
+  }
+  for (tail = 0; tail < log.clh.n; tail++) {
+    bio_wait(&log.shadow[tail]);
+    releasesleep(&log.shadow[tail].lock);
+  }
+
+  if (~cksum_slots(~0, 0) == log.clh.cksum)
+    write_shadows(0, 1); // if committed, copy from log to disk
+  log.clh.n = 0;
+  log.crc = ~0;
+}
+
+// Close the open transaction.  Returns 1 if the caller must
+// now commit it.  Caller must hold log.lock.
+static int
+closelog(void)
+{
+  log.closing = 1;
+  if(log.outstanding == 0 && !log.committing){
+    log.committing = 1;
+    return 1;
+  }
+  return 0;
 }
 
 // called at the start of each FS system call.
@@ -127,11 +240,17 @@ begin_op(void)
 {
   acquire(&log.lock);
   while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    if(log.copying || log.closing){
       sleep(&log, &log.lock);
+    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > log.size){
+      // this op might exhaust log space; commit.
+      if(closelog()){
+        release(&log.lock);
+        commit();
+        acquire(&log.lock);
+      } else {
+        sleep(&log, &log.lock);
+      }
     } else {
       log.outstanding += 1;
       release(&log.lock);
@@ -141,7 +260,8 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation
+// of a closed transaction.
 void
 end_op(void)
 {
@@ -149,9 +269,7 @@ end_op(void)
 
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
+  if(log.outstanding == 0 && log.closing && !log.committing){
     do_commit = 1;
     log.committing = 1;
   } else {
@@ -166,44 +284,245 @@ end_op(void)
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
     commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// The number the open transaction will have once committed,
+// for a caller inside an FS system call to note what its
+// updates go into.
+int
+log_opseq(void)
+{
+  int seq;
+
+  acquire(&log.lock);
+  seq = log.seq + 1;
+  release(&log.lock);
+  return seq;
+}
+
+// Wait until transaction target and those before it are
+// durable, committing the open transaction if it is target.
+void
+log_syncto(int target)
+{
+  int do_commit;
+
+  acquire(&log.lock);
+  do_commit = 0;
+  if(target > log.seq && log.lh.n > 0)
+    do_commit = closelog();
+  release(&log.lock);
+
+  if(do_commit)
+    commit();
+
+  acquire(&log.lock);
+  while(log.done < target && (target <= log.seq || log.lh.n > 0))
+    sleep(&log, &log.lock);
+  release(&log.lock);
+}
+
+// Make all FS system calls that have finished durable.
+void
+log_sync(void)
+{
+  int target;
+
+  acquire(&log.lock);
+  target = log.seq + (log.lh.n > 0);
+  release(&log.lock);
+  log_syncto(target);
+}
+
+// Copy the blocks of the transaction being committed, in log
+// slots from on, from the cache into the shadow buffers.  They
+// stay pinned in the cache until checkpointed, so bread() does
+// not go to disk.
 static void
-write_log(void)
+copy_trans(int from)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+  for (tail = from; tail < log.clh.n; tail++) {
+    struct buf *from = bread(log.dev, log.clh.block[tail]); // cache block
+    memmove(log.shadow[tail].data, from->data, BSIZE);
     brelse(from);
-    brelse(to);
   }
 }
 
+// Does a later log slot hold a newer copy of slot tail's block?
+static int
+superseded(int tail)
+{
+  int i;
+
+  for (i = tail+1; i < log.clh.n; i++)
+    if (log.clh.block[i] == log.clh.block[tail])
+      return 1;
+  return 0;
+}
+
+// Write the shadow buffers in log slots from on to the log if
+// home is 0, else the latest copy of each block to its home
+// location.  The shadows are not in the buffer cache, so the
+// open transaction's newer copies are untouched.  Returns the
+// number of blocks written.
+static int
+write_shadows(int from, int home)
+{
+  int tail, n;
+  struct buf *b;
+
+  // Start all the writes, then wait for them.
+  n = 0;
+  for (tail = from; tail < log.clh.n; tail++) {
+    if (home && superseded(tail))
+      continue;
+    b = &log.shadow[tail];
+    acquiresleep(&b->lock);
+    b->blockno = home ? log.clh.block[tail] : log.start+tail+1;
+    b->flags = B_DIRTY;
+    bio_submit(b, 0);
+    n++;
+  }
+  for (tail = from; tail < log.clh.n; tail++) {
+    if (home && superseded(tail))
+      continue;
+    b = &log.shadow[tail];
+    bio_wait(b);
+    releasesleep(&b->lock);
+  }
+  return n;
+}
+
+// Let the cache evict the checkpointed blocks again, unless the
+// open transaction has logged them since.
+static void
+unpin_trans(void)
+{
+  int tail, i;
+
+  for (tail = 0; tail < log.clh.n; tail++) {
+    if (superseded(tail))
+      continue;
+    struct buf *b = bread(log.dev, log.clh.block[tail]);
+    // Holding b's lock keeps log_write() from adding it now.
+    acquire(&log.lock);
+    for (i = 0; i < log.lh.n; i++)
+      if (log.lh.block[i] == b->blockno)
+        break;
+    if (i == log.lh.n)
+      b->flags &= ~B_DIRTY;
+    release(&log.lock);
+    brelse(b);
+  }
+}
+
+// Write the latest copy of every block in the log home, and
+// empty the log.  The next commit will overwrite the log slots,
+// which voids the stale header's checksum.
+static void
+checkpoint(void)
+{
+  int n;
+
+  n = write_shadows(0, 1);
+  acquire(&log.lock);
+  log.ninstall += n;
+  release(&log.lock);
+  unpin_trans();
+  log.clh.n = 0;
+  log.crc = ~0;
+}
+
+// Commit the open transaction if it is closed, then any that
+// were closed meanwhile.  Caller has set log.committing.
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
+  int from;
+
+  for(;;){
+    acquire(&log.lock);
+    if(!log.closing || log.outstanding > 0 || log.lh.n == 0){
+      // Nothing to commit, or an op still running in the
+      // open transaction will commit it when it ends.
+      if(log.lh.n == 0)
+        log.closing = 0;
+      log.committing = 0;
+      wakeup(&log);
+      release(&log.lock);
+      return;
+    }
+    if(log.clh.n + log.lh.n > log.size){
+      // No room to append; make some.
+      release(&log.lock);
+      checkpoint();
+      continue;
+    }
+    from = log.clh.n;
+    memmove(&log.clh.block[from], log.lh.block, log.lh.n * sizeof(log.lh.block[0]));
+    log.clh.n += log.lh.n;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    log.closing = 0;
+    log.copying = 1;
+    log.seq++;
+    release(&log.lock);
+
+    copy_trans(from);  // Snapshot modified blocks from cache
+
+    acquire(&log.lock);
+    log.copying = 0;
+    wakeup(&log);      // The next transaction may start
+    release(&log.lock);
+
+    log.crc = cksum_slots(log.crc, from);
+    log.clh.cksum = ~log.crc;
+    write_shadows(from, 0);  // Append the copies to the log
+    write_head(&log.clh);    // Write header to disk -- the real commit
+
+    acquire(&log.lock);
+    log.done++;
+    wakeup(&log);      // sync() may be waiting
+    release(&log.lock);
+  }
+}
+
+// Kernel thread that commits buffered FS updates every
+// FLUSHTICKS, and checkpoints the log once it is half full so
+// that commits seldom have to.
+static void
+flusher(void)
+{
+  int do_commit, do_ckpt;
+  uint t0;
+
+  for(;;){
+    acquire(&tickslock);
+    t0 = ticks;
+    while(ticks - t0 < FLUSHTICKS)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    acquire(&log.lock);
+    do_commit = do_ckpt = 0;
+    if(log.lh.n > 0)
+      do_commit = closelog();
+    else if(!log.committing && log.clh.n > log.size/2)
+      do_ckpt = log.committing = 1;
+    release(&log.lock);
+
+    if(do_ckpt)
+      checkpoint();
+    if(do_commit || do_ckpt)
+      commit();
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// commit() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -215,7 +534,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.size)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -232,3 +551,12 @@ log_write(struct buf *b)
   release(&log.lock);
 }
 
+// Report log statistics.
+void
+log_stat(struct iostat *st)
+{
+  acquire(&log.lock);
+  st->ncommit = log.done;
+  st->ninstall = log.ninstall;
+  release(&log.lock);
+}
@@ -3,12 +3,21 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // minimum size of i-node cache
+#define ICACHEDIV    64  // i-node cache may grow to 1/ICACHEDIV of free memory
+#define NDENTRY     512  // cached directory entries
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define NIMGSEG       4  // max loadable ELF segments per process image
+#define NVMA         16  // max mmap() regions per process
+#define NSHPAGE     512  // max pages in MAP_SHARED file mappings
+#define MAXOPBLOCKS  13  // max # of blocks any FS op writes
+#define LOGSIZE      (MAXOPBLOCKS*9)  // blocks in on-disk log made by mkfs
+#define NBUF         (LOGSIZE*3)  // minimum size of disk block cache
+#define BCACHEDIV    8  // disk block cache gets 1/BCACHEDIV of free memory
+#define MAXRA        64  // max read-ahead window, in blocks
+#define IOSCHED  "cscan"  // disk I/O scheduler: "fifo" or "cscan"
+#define FSSIZE       4000  // size of file system in blocks
+#define FLUSHTICKS   100  // ticks between commits of buffered FS updates
 
@@ -0,0 +1,70 @@
+// PCI configuration space, through I/O ports 0xCF8/0xCFC
+// (configuration mechanism #1).  Just enough to find a device,
+// read its registers, and turn on bus mastering.
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+#include "pci.h"
+
+#define CONFADDR  0xcf8
+#define CONFDATA  0xcfc
+
+// A device function is named by bus<<8 | dev<<3 | func.
+// Only bus 0 is searched, which is where QEMU puts devices.
+
+// Read 32-bit register reg of function f.
+uint
+pciread(int f, int reg)
+{
+  outl(CONFADDR, 0x80000000 | (f << 8) | (reg & 0xfc));
+  return inl(CONFDATA);
+}
+
+void
+pciwrite(int f, int reg, uint v)
+{
+  outl(CONFADDR, 0x80000000 | (f << 8) | (reg & 0xfc));
+  outl(CONFDATA, v);
+}
+
+// Return the first function whose register reg, masked with
+// mask, equals val, or -1 if there is none.
+static int
+pcifind(int reg, uint mask, uint val)
+{
+  int dev, f;
+
+  for(dev = 0; dev < 32; dev++){
+    if((pciread(dev<<3, PCI_ID) & 0xffff) == 0xffff)
+      continue;  // no such device
+    for(f = dev<<3; f < (dev+1)<<3; f++){
+      if((pciread(f, PCI_ID) & 0xffff) == 0xffff)
+        continue;
+      if((pciread(f, reg) & mask) == val)
+        return f;
+    }
+  }
+  return -1;
+}
+
+// Find a function by vendor and device id.
+int
+pcifindid(uint vendor, uint device)
+{
+  return pcifind(PCI_ID, 0xffffffff, device << 16 | vendor);
+}
+
+// Find a function by class and subclass.
+int
+pcifindclass(uint class, uint subclass)
+{
+  return pcifind(PCI_CLASS, 0xffff0000, class << 24 | subclass << 16);
+}
+
+// Let function f master the bus, for DMA.
+void
+pcimaster(int f)
+{
+  pciwrite(f, PCI_CMD, pciread(f, PCI_CMD) | PCI_CMD_IO | PCI_CMD_MASTER);
+}
@@ -0,0 +1,11 @@
+// PCI configuration space registers.
+
+#define PCI_ID          0x00    // device<<16 | vendor
+#define PCI_CMD         0x04    // status<<16 | command
+#define PCI_CLASS       0x08    // class<<24 | subclass<<16 | progif<<8 | rev
+#define PCI_BAR0        0x10    // base address registers
+#define PCI_BAR4        0x20
+#define PCI_INTR        0x3c    // interrupt line in low byte
+
+#define PCI_CMD_IO      0x1     // respond to I/O space accesses
+#define PCI_CMD_MASTER  0x4     // bus master
@@ -0,0 +1,58 @@
+// Context-switch benchmark: two processes bounce a byte back
+// and forth over a pair of pipes, so every round trip costs two
+// switches between address spaces.
+//
+//   pingpong [rounds]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int to[2], from[2], i, n, pid, t0, t1;
+  char c;
+
+  n = 10000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+
+  if(pipe(to) < 0 || pipe(from) < 0){
+    printf(1, "pingpong: pipe failed\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "pingpong: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(to[1]);
+    close(from[0]);
+    while(read(to[0], &c, 1) == 1)
+      write(from[1], &c, 1);
+    exit();
+  }
+  close(to[0]);
+  close(from[1]);
+
+  c = 'x';
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(write(to[1], &c, 1) != 1 || read(from[0], &c, 1) != 1){
+      printf(1, "pingpong: pipe broke after %d rounds\n", i);
+      break;
+    }
+  }
+  t1 = uptime();
+  close(to[1]);
+  close(from[0]);
+  wait();
+
+  printf(1, "pingpong: %d round trips in %d ticks\n", i, t1 - t0);
+  if(t1 > t0)
+    printf(1, "pingpong: %d round trips per tick\n", i / (t1 - t0));
+  exit();
+}
@@ -8,7 +8,7 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#define PIPESIZE 2048  // power of 2, so nwrite % PIPESIZE survives wrap
 
 struct pipe {
   struct spinlock lock;
@@ -119,3 +119,38 @@ piperead(struct pipe *p, char *addr, int n)
   release(&p->lock);
   return i;
 }
+
+// sendfile() fills a pipe straight from the buffer cache, where
+// it cannot sleep, so it waits for room first with pipewait()
+// and then copies with pipeput(), which never waits.
+// Returns -1 if the pipe is full and nobody will empty it.
+int
+pipewait(struct pipe *p)
+{
+  acquire(&p->lock);
+  while(p->nwrite == p->nread + PIPESIZE){
+    if(p->readopen == 0 || myproc()->killed){
+      release(&p->lock);
+      return -1;
+    }
+    wakeup(&p->nread);
+    sleep(&p->nwrite, &p->lock);
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Copy as much of addr[0..n-1] into p as fits, without waiting.
+// Returns the number of bytes copied.
+int
+pipeput(struct pipe *p, char *addr, int n)
+{
+  int i;
+
+  acquire(&p->lock);
+  for(i = 0; i < n && p->nwrite != p->nread + PIPESIZE; i++)
+    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+  wakeup(&p->nread);
+  release(&p->lock);
+  return i;
+}
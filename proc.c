@@ -497,16 +497,43 @@ userinit(void)
   insert_proc(tasks, p);
 }
 
+// Start a kernel-only thread running fn(), which must never
+// return.  It has the kernel's address space and no user memory,
+// open files or working directory.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread: no proc");
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kthread: out of memory?");
+  // forkret() returns to fn instead of trapret.
+  *(uint*)(p->context + 1) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+
+  insert_proc(tasks, p);
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
+  int i;
   uint sz;
   struct proc *curproc = myproc();
 
   sz = curproc->sz;
   if(n > 0){
+    for(i = 0; i < NVMA; i++)
+      if(curproc->vma[i].start && sz + n > curproc->vma[i].start)
+        return -1;  // would run into a mapping
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   } else if(n < 0){
@@ -540,6 +567,14 @@ fork(void)
     np->state = UNUSED;
     return -1;
   }
+  if(copyvmas(np, curproc) < 0){
+    freevmas(np);
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
   np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
@@ -551,6 +586,11 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  for(i = 0; i < NIMGSEG; i++){
+    np->imgseg[i] = curproc->imgseg[i];
+    if(np->imgseg[i].ip)
+      itext(np->imgseg[i].ip);
+  }
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -581,7 +621,8 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
+  // Write back and drop mappings, then close all open files.
+  freevmas(curproc);
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
       fileclose(curproc->ofile[fd]);
@@ -590,6 +631,7 @@ exit(void)
   }
 
   begin_op();
+  freeimgseg(curproc->imgseg);
   iput(curproc->cwd);
   end_op();
   curproc->cwd = 0;
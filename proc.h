@@ -32,6 +32,28 @@ struct context {
   uint eip;
 };
 
+// A loadable segment of the program image.  exec() records these
+// instead of reading them in; faultuvm() reads each page from the
+// inode the first time it is touched.
+struct imgseg {
+  struct inode *ip;            // Executable, or 0 if slot unused
+  uint va;                     // Page-aligned start of segment
+  uint off;                    // Offset of segment in ip
+  uint filesz;                 // Bytes backed by ip; rest is zero
+};
+
+// A region of memory created by mmap().  Its pages are filled in
+// by faultuvm() on first touch, from f at offset off if the
+// mapping is backed by a file, or with zeroes if it is anonymous.
+struct vma {
+  uint start;                  // Page-aligned start, or 0 if slot unused
+  uint end;                    // Page-aligned end
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE, MAP_ANONYMOUS
+  struct file *f;              // Backing file, or 0 if anonymous
+  uint off;                    // Offset in f of start
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 
@@ -55,6 +77,8 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct imgseg imgseg[NIMGSEG]; // Demand-paged program segments
+  struct vma vma[NVMA];        // Memory-mapped regions
   
   // ---------------  TODO  --------------- 
   // each process in red black tree approach needs three pointers to other processes
@@ -73,3 +97,5 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+// mmap() regions are placed top-down from KERNBASE, and the heap
+// may not grow into them.
@@ -1,8 +1,8 @@
-// Demonstrate that moving the "acquire" in iderw after the loop that
-// appends to the idequeue results in a race.
+// Demonstrate that moving the "acquire" in idesubmit after the call
+// that adds to the I/O scheduler's queue results in a race.
 
-// For this to work, you should also add a spin within iderw's
-// idequeue traversal loop.  Adding the following demonstrated a panic
+// For this to work, you should also add a spin within the scheduler's
+// queue traversal loop.  Adding the following demonstrated a panic
 // after about 5 runs of stressfs in QEMU on a 2.1GHz CPU:
 //    for (i = 0; i < 40000; i++)
 //      asm volatile("");
@@ -19,14 +19,18 @@ fetchint(uint addr, int *ip)
 {
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(addr+4 < addr || addr+4 > limituvm(curproc, addr))
+    return -1;
+  if(touchuvm(curproc, addr, 4) < 0)
     return -1;
   *ip = *(int*)(addr);
   return 0;
 }
 
 // Fetch the nul-terminated string at addr from the current process.
-// Doesn't actually copy the string - just sets *pp to point at it.
+// Doesn't actually copy the string - just sets *pp to point at it,
+// so refuses a string in a MAP_SHARED mapping, where another
+// process could overwrite the nul while the kernel uses it.
 // Returns length of string, not including nul.
 int
 fetchstr(uint addr, char **pp)
@@ -34,11 +38,13 @@ fetchstr(uint addr, char **pp)
   char *s, *ep;
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
+  if((ep = (char*)limituvm(curproc, addr)) == 0 || shareduvm(curproc, addr))
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
+    if(s == *pp || (uint)s % PGSIZE == 0)
+      if(touchuvm(curproc, (uint)s, 1) < 0)
+        return -1;
     if(*s == 0)
       return s - *pp;
   }
@@ -52,27 +58,55 @@ argint(int n, int *ip)
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
+// Fetch the block of size bytes at addr from the current process.
+// Check that it lies within the process address space, and
+// fault in any of it that is not present yet.
+// Doesn't copy the block - just sets *pp to point at it.
+int
+fetchptr(uint addr, char **pp, int size)
+{
+  uint end;
+  struct proc *curproc = myproc();
+
+  end = limituvm(curproc, addr);
+  if(size < 0 || end == 0 || addr+size < addr || addr+size > end)
+    return -1;
+  if(touchuvm(curproc, addr, size) < 0)
+    return -1;
+  *pp = (char*)addr;
+  return 0;
+}
+
 // Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// to a block of memory of size bytes.  See fetchptr().
 int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  return fetchptr(i, pp, size);
+}
+
+// Like argptr, for a block the kernel will store into.
+// Fails if it overlaps a read-only mapping, which the kernel
+// would otherwise fault on.
+int
+argwptr(int n, char **pp, int size)
+{
+  if(argptr(n, pp, size) < 0)
+    return -1;
+  if(!writableuvm(myproc(), (uint)*pp, size))
     return -1;
-  *pp = (char*)i;
   return 0;
 }
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (The string is in memory private to the process, see fetchstr(),
+// so it can't change between this check and being used by the
+// kernel.)
 int
 argstr(int n, char **pp)
 {
@@ -103,6 +137,17 @@ extern int sys_unlink(void);
 extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_iostat(void);
+extern int sys_sync(void);
+extern int sys_fsync(void);
+extern int sys_sendfile(void);
+extern int sys_splice(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -126,6 +171,17 @@ static int (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_iostat]  sys_iostat,
+[SYS_sync]    sys_sync,
+[SYS_fsync]   sys_fsync,
+[SYS_sendfile] sys_sendfile,
+[SYS_splice]  sys_splice,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
 };
 
 void
@@ -20,3 +20,14 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_mmap   22
+#define SYS_munmap 23
+#define SYS_iostat 24
+#define SYS_sync   25
+#define SYS_fsync  26
+#define SYS_sendfile 27
+#define SYS_splice 28
+#define SYS_readv  29
+#define SYS_writev 30
+#define SYS_pread  31
+#define SYS_pwrite 32
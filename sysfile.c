@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "iostat.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -73,7 +75,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argwptr(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -90,6 +92,82 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the nth argument as an array of cnt iovecs into iov,
+// checking that each buffer is in the process, and that the
+// kernel can store into it if write is set.
+static int
+argiov(int n, int cnt, struct iovec *iov, int write)
+{
+  struct iovec *uiov;
+  char *p;
+  int i;
+
+  if(cnt < 0 || cnt > IOV_MAX ||
+     argptr(n, (void*)&uiov, cnt*sizeof(uiov[0])) < 0)
+    return -1;
+  memmove(iov, uiov, cnt*sizeof(uiov[0]));
+  for(i = 0; i < cnt; i++){
+    if(fetchptr((uint)iov[i].base, &p, iov[i].len) < 0)
+      return -1;
+    if(write && !writableuvm(myproc(), (uint)p, iov[i].len))
+      return -1;
+  }
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov, 1) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov, 0) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
+}
+
+// int pread(int fd, void *buf, int n, int off)
+// Like read() at off, without using or moving the file offset.
+int
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argwptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+// int pwrite(int fd, void *buf, int n, int off)
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
 int
 sys_close(void)
 {
@@ -109,11 +187,72 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argwptr(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
 
+// int sendfile(int out, int in, int off, int n)
+// Copy up to n bytes of in, from off or from in's offset if off
+// is negative, to out inside the kernel.
+int
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  int off, n;
+  uint o;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 ||
+     argint(2, &off) < 0 || argint(3, &n) < 0)
+    return -1;
+  o = off;
+  return filesend(out, in, off < 0 ? 0 : &o, n);
+}
+
+// int splice(int in, int out, int n)
+// Like sendfile() at the file offsets, but one end must be a pipe.
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(in->type != FD_PIPE && out->type != FD_PIPE)
+    return -1;
+  return filesend(out, in, 0, n);
+}
+
+// FS updates are buffered in the log; make them durable.
+int
+sys_sync(void)
+{
+  log_sync();
+  return 0;
+}
+
+// Make f's updates durable: commit the transaction that last
+// changed f's inode, and with it those before it, if it is not
+// on disk already.  Unlike sync(), fsync() of a file with no
+// new updates does not force a commit.
+int
+sys_fsync(void)
+{
+  struct file *f;
+  int seq;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(f->type != FD_INODE)
+    return 0;
+  ilock(f->ip);
+  seq = f->ip->lseq;
+  iunlock(f->ip);
+  log_syncto(seq);
+  return 0;
+}
+
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
@@ -218,6 +357,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dirforget(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -274,8 +414,18 @@ create(char *path, short type, short major, short minor)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // Undo; with no links, iput() frees ip.
+    if(type == T_DIR){
+      dp->nlink--;
+      iupdate(dp);
+    }
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    return 0;
+  }
 
   iunlockput(dp);
 
@@ -286,7 +436,7 @@ int
 sys_open(void)
 {
   char *path;
-  int fd, omode;
+  int fd, omode, writable;
   struct file *f;
   struct inode *ip;
 
@@ -314,9 +464,19 @@ sys_open(void)
     }
   }
 
+  // The file of a running program cannot be written.
+  writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  if(writable && iwopen(ip) < 0){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+
   if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
     if(f)
       fileclose(f);
+    if(writable)
+      iwclose(ip);
     iunlockput(ip);
     end_op();
     return -1;
@@ -328,7 +488,7 @@ sys_open(void)
   f->ip = ip;
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
-  f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->writable = writable;
   return fd;
 }
 
@@ -426,7 +586,7 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argwptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
@@ -442,3 +602,60 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+// void *mmap(void *addr, int len, int prot, int flags, int fd, int off)
+// The kernel chooses the address; addr is only a hint and is ignored.
+int
+sys_mmap(void)
+{
+  int len, prot, flags, fd, off;
+  struct file *f;
+  struct stat st;
+
+  if(argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return -1;
+
+  f = 0;
+  if((flags & MAP_ANONYMOUS) == 0){
+    if(argfd(4, &fd, &f) < 0)
+      return -1;
+    if(f->type != FD_INODE || filestat(f, &st) < 0 || st.type != T_FILE)
+      return -1;
+    if(!f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+  return mmapuvm(myproc(), len, prot, flags, f, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len, r;
+  struct proc *curproc = myproc();
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  // Even if a write-back failed, pages may have been unmapped.
+  r = munmapuvm(curproc, addr, len);
+  switchuvm(curproc);
+  return r;
+}
+
+int
+sys_iostat(void)
+{
+  struct iostat *st;
+
+  if(argwptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  bstat(st);
+  log_stat(st);
+  return 0;
+}
@@ -79,6 +79,14 @@ trap(struct trapframe *tf)
     break;
 
   //PAGEBREAK: 13
+  case T_PGFLT:
+    // Fault in a page of the program image that exec()
+    // left unmapped, or of an mmap() region.  Anything else
+    // is a real fault.
+    if(myproc() && (tf->cs&3) == DPL_USER &&
+       faultuvm(myproc(), rcr2()) == 0)
+      break;
+    // fall through
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct iostat;
+struct iovec;
 
 // system calls
 int fork(void);
@@ -23,6 +25,17 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int iostat(struct iostat*);
+int sync(void);
+int fsync(int);
+int sendfile(int, int, int, int);
+int splice(int, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
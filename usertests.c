@@ -4,6 +4,8 @@
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "iostat.h"
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
@@ -184,6 +186,9 @@ writetest(void)
   printf(stdout, "small file test ok\n");
 }
 
+// Reaches into the double-indirect blocks.
+#define BIGBLOCKS (NDIRECT + NINDIRECT + 200)
+
 void
 writetest1(void)
 {
@@ -197,9 +202,9 @@ writetest1(void)
     exit();
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
-    if(write(fd, buf, 512) != 512){
+    if(write(fd, buf, BSIZE) != BSIZE){
       printf(stdout, "error: write big file failed\n", i);
       exit();
     }
@@ -215,14 +220,14 @@ writetest1(void)
 
   n = 0;
   for(;;){
-    i = read(fd, buf, 512);
+    i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGBLOCKS){
         printf(stdout, "read only %d blocks from big", n);
         exit();
       }
       break;
-    } else if(i != 512){
+    } else if(i != BSIZE){
       printf(stdout, "read failed %d\n", i);
       exit();
     }
@@ -241,6 +246,76 @@ writetest1(void)
   printf(stdout, "big files ok\n");
 }
 
+// Read-ahead must stop at the end of the file: sequential reads
+// of files of awkward sizes return exactly their bytes, a file
+// that grows after a reader reached its end reads on correctly,
+// and a file recreated over the same blocks shows its new data.
+void
+readaheadtest(void)
+{
+  static int sizes[] = { 0, 1, BSIZE-1, BSIZE, BSIZE+1, 5*BSIZE+7, 70*BSIZE+3 };
+  int fd, i, j, k, n, size, tot;
+
+  printf(stdout, "readahead test\n");
+  for(k = 0; k < 2; k++){
+    for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+      size = sizes[i];
+      unlink("rafile");
+      fd = open("rafile", O_CREATE|O_RDWR);
+      if(fd < 0){
+        printf(stdout, "readahead: create failed\n");
+        exit();
+      }
+      for(tot = 0; tot < size; tot += n){
+        n = size - tot < BSIZE ? size - tot : BSIZE;
+        for(j = 0; j < n; j++)
+          buf[j] = (tot + j) * 7 + size + k;
+        if(write(fd, buf, n) != n){
+          printf(stdout, "readahead: write failed\n");
+          exit();
+        }
+      }
+      close(fd);
+
+      fd = open("rafile", O_RDWR);
+      for(tot = 0; (n = read(fd, buf, 300)) > 0; tot += n){
+        for(j = 0; j < n; j++){
+          if(buf[j] != (char)((tot + j) * 7 + size + k)){
+            printf(stdout, "readahead: wrong data at %d of %d\n", tot + j, size);
+            exit();
+          }
+        }
+      }
+      if(n < 0 || tot != size || read(fd, buf, 300) != 0){
+        printf(stdout, "readahead: read %d of %d\n", tot, size);
+        exit();
+      }
+
+      // grow it past where read-ahead stopped, and read on
+      memset(buf, 'g', 2*BSIZE);
+      if(write(fd, buf, 2*BSIZE) != 2*BSIZE){
+        printf(stdout, "readahead: append failed\n");
+        exit();
+      }
+      for(tot = 0; (n = pread(fd, buf, 300, size + tot)) > 0; tot += n){
+        for(j = 0; j < n; j++){
+          if(buf[j] != 'g'){
+            printf(stdout, "readahead: wrong appended data\n");
+            exit();
+          }
+        }
+      }
+      if(tot != 2*BSIZE){
+        printf(stdout, "readahead: read %d appended bytes\n", tot);
+        exit();
+      }
+      close(fd);
+    }
+  }
+  unlink("rafile");
+  printf(stdout, "readahead ok\n");
+}
+
 void
 createtest(void)
 {
@@ -300,6 +375,95 @@ exectest(void)
   }
 }
 
+#define LAZYDATA (16*4096)
+#define LAZYBSS (256*4096)
+
+char lazydata[LAZYDATA] = { [0] = 1, [LAZYDATA/2] = 2, [LAZYDATA-1] = 3 };
+char lazybss[LAZYBSS];
+
+// Does exec() of args[0] fail?  Tries it in a child.
+int
+execfails(char **args)
+{
+  int fds[2], r;
+  char c;
+
+  if(pipe(fds) != 0){
+    printf(stdout, "pipe failed\n");
+    exit();
+  }
+  if(fork() == 0){
+    close(fds[0]);
+    exec(args[0], args);
+    write(fds[1], "f", 1);
+    exit();
+  }
+  close(fds[1]);
+  r = read(fds[0], &c, 1) == 1;
+  close(fds[0]);
+  wait();
+  return r;
+}
+
+// exec() loads pages on first touch: a child forked before any
+// of a big data and bss segment is touched must still see the
+// right contents, as must a program exec'd from such a child.
+// Meanwhile the running program's file cannot be written, and
+// a file that may be written cannot be run.
+void
+lazytest(void)
+{
+  char *args[] = { "echo", "lazy", "exec", "ok", 0 };
+  int fd, pid;
+  char *p;
+
+  printf(stdout, "lazy test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "lazy: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(fork() == 0){
+      exec("echo", args);
+      printf(stdout, "lazy: exec failed\n");
+      exit();
+    }
+    wait();
+    if(lazydata[0] != 1 || lazydata[LAZYDATA/2] != 2 ||
+       lazydata[LAZYDATA-1] != 3 || lazydata[1] != 0 ||
+       lazybss[0] != 0 || lazybss[LAZYBSS-1] != 0){
+      printf(stdout, "lazy: child sees wrong data\n");
+      exit();
+    }
+    lazybss[0] = 1;
+    exit();
+  }
+  wait();
+  if(lazybss[0] != 0 || lazydata[LAZYDATA-1] != 3){
+    printf(stdout, "lazy: parent sees child's store\n");
+    exit();
+  }
+  if(open("usertests", O_RDWR) >= 0 || (fd = open("usertests", O_RDONLY)) < 0){
+    printf(stdout, "lazy: running program's file opened for writing\n");
+    exit();
+  }
+  close(fd);
+  fd = open("echo", O_RDWR);
+  if(fd < 0 || !execfails(args)){
+    printf(stdout, "lazy: ran a program open for writing\n");
+    exit();
+  }
+  p = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == (char*)-1 || !execfails(args)){
+    printf(stdout, "lazy: ran a program mapped for writing\n");
+    exit();
+  }
+  munmap(p, 4096);
+  printf(stdout, "lazy ok\n");
+}
+
 // simple fork and pipe read/write
 
 void
@@ -579,6 +743,265 @@ fourfiles(void)
   printf(1, "fourfiles ok\n");
 }
 
+#define NMERGEBLOCK 320  // a multiple of sizeof(buf)/BSIZE
+
+// A commit sends runs of adjacent blocks to the disk driver, which
+// merges them into multi-sector commands: writing out a big file
+// must merge requests.
+void
+mergetest(void)
+{
+  struct iostat st0, st1;
+  int fd, b, i, n;
+
+  printf(1, "merge test\n");
+  fd = open("mergefile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "merge: create failed\n");
+    exit();
+  }
+  sync();
+  iostat(&st0);
+  n = sizeof(buf) / BSIZE;
+  for(b = 0; b < NMERGEBLOCK; b += n){
+    for(i = 0; i < n; i++)
+      memset(buf + i*BSIZE, b + i, BSIZE);
+    if(write(fd, buf, n*BSIZE) != n*BSIZE){
+      printf(1, "merge: write failed\n");
+      exit();
+    }
+  }
+  if(fsync(fd) != 0){
+    printf(1, "merge: fsync failed\n");
+    exit();
+  }
+  iostat(&st1);
+  // A driver that never merges, like kernelvirtio's, is exempt.
+  if(st1.nmerge == st0.nmerge && st1.nmerge != 0){
+    printf(1, "merge: no requests merged\n");
+    exit();
+  }
+  for(b = 0; b < NMERGEBLOCK; b++){
+    if(pread(fd, buf, BSIZE, b*BSIZE) != BSIZE ||
+       buf[0] != (char)b || buf[BSIZE-1] != (char)b){
+      printf(1, "merge: block %d has wrong data\n", b);
+      exit();
+    }
+  }
+  close(fd);
+  unlink("mergefile");
+  printf(1, "merge ok\n");
+}
+
+#define NGCPROC 6
+#define NGCBLOCK 8   // per process
+
+// Group commit lets system calls log new updates while an earlier
+// group is still being written.  Processes rewrite their own blocks
+// of one shared file and create and remove files in one directory,
+// calling fsync() each round, so the inode, directory and bitmap
+// blocks are logged again while they are being committed.  At the
+// end every block must hold its owner's last write.
+void
+groupcommit(void)
+{
+  struct iostat st0, st1;
+  char name[4];
+  int fd, fds[2], pi, r, b;
+  char c;
+
+  printf(1, "group commit test\n");
+  iostat(&st0);
+  fd = open("gcfile", O_CREATE|O_RDWR);
+  memset(buf, 0, BSIZE);
+  for(b = 0; fd >= 0 && b < NGCPROC*NGCBLOCK; b++){
+    if(write(fd, buf, BSIZE) != BSIZE)
+      break;
+  }
+  if(fd < 0 || b < NGCPROC*NGCBLOCK || pipe(fds) != 0){
+    printf(1, "group commit: setup failed\n");
+    exit();
+  }
+  close(fd);
+  for(pi = 0; pi < NGCPROC; pi++){
+    if(fork() == 0){
+      close(fds[0]);
+      c = 'y';
+      name[0] = 'g';
+      name[1] = 'c';
+      name[2] = '0' + pi;
+      name[3] = '\0';
+      fd = open("gcfile", O_RDWR);
+      for(r = 1; fd >= 0 && c == 'y' && r <= 10; r++){
+        for(b = pi*NGCBLOCK; b < (pi+1)*NGCBLOCK; b++){
+          memset(buf, r, BSIZE);
+          buf[0] = b;
+          if(pwrite(fd, buf, BSIZE, b*BSIZE) != BSIZE)
+            c = 'n';
+        }
+        if(close(open(name, O_CREATE|O_RDWR)) != 0 || unlink(name) != 0)
+          c = 'n';
+        if(fsync(fd) != 0)
+          c = 'n';
+      }
+      if(fd < 0)
+        c = 'n';
+      close(fd);
+      write(fds[1], &c, 1);
+      exit();
+    }
+  }
+  close(fds[1]);
+  for(pi = 0; pi < NGCPROC; pi++){
+    if(read(fds[0], &c, 1) != 1 || c != 'y'){
+      printf(1, "group commit: writer failed\n");
+      exit();
+    }
+    wait();
+  }
+  close(fds[0]);
+
+  fd = open("gcfile", O_RDONLY);
+  for(b = 0; b < NGCPROC*NGCBLOCK; b++){
+    if(read(fd, buf, BSIZE) != BSIZE || buf[0] != b ||
+       buf[1] != 10 || buf[BSIZE-1] != 10){
+      printf(1, "group commit: block %d has wrong data\n", b);
+      exit();
+    }
+  }
+  close(fd);
+  iostat(&st1);
+  if(st1.ncommit <= st0.ncommit){
+    printf(1, "group commit: nothing committed\n");
+    exit();
+  }
+  unlink("gcfile");
+  printf(1, "group commit ok\n");
+}
+
+#define NLOGBLOCK 150  // more than the default log holds
+
+// One commit may carry many transactions, and a log that fills
+// must be committed and checkpointed before more is logged.  Each
+// single-block write() is its own transaction; none is forced out
+// until the final fsync(), but the file does not fit in one commit.
+void
+logtest(void)
+{
+  struct iostat st0, st1;
+  int fd, b;
+
+  printf(1, "log test\n");
+  iostat(&st0);
+  fd = open("logfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "log: create failed\n");
+    exit();
+  }
+  for(b = 0; b < NLOGBLOCK; b++){
+    memset(buf, b, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf(1, "log: write failed\n");
+      exit();
+    }
+  }
+  if(fsync(fd) != 0){
+    printf(1, "log: fsync failed\n");
+    exit();
+  }
+  iostat(&st1);
+  if(st1.ncommit - st0.ncommit < 2){
+    printf(1, "log: full log not committed\n");
+    exit();
+  }
+  for(b = 0; b < NLOGBLOCK; b++){
+    if(pread(fd, buf, BSIZE, b*BSIZE) != BSIZE ||
+       buf[0] != (char)b || buf[BSIZE-1] != (char)b){
+      printf(1, "log: block %d has wrong data\n", b);
+      exit();
+    }
+  }
+  close(fd);
+  unlink("logfile");
+  printf(1, "log ok\n");
+}
+
+// Committed blocks go home only when the log fills, and then only
+// their newest copy.  Rewrite the same blocks over many commits, so
+// that the log fills with old copies several times: far fewer
+// blocks than were committed may be written home.  Then free the
+// blocks and reuse them for a new file before they are checkpointed.
+void
+checkpointtest(void)
+{
+  struct iostat st0, st1;
+  int fd, b, r;
+
+  printf(1, "checkpoint test\n");
+  fd = open("ckfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "checkpoint: create failed\n");
+    exit();
+  }
+  iostat(&st0);
+  for(r = 0; r < 30; r++){
+    for(b = 0; b < 20; b++){
+      memset(buf, r, BSIZE);
+      buf[0] = b;
+      if(pwrite(fd, buf, BSIZE, b*BSIZE) != BSIZE){
+        printf(1, "checkpoint: write failed\n");
+        exit();
+      }
+    }
+    if(fsync(fd) != 0){
+      printf(1, "checkpoint: fsync failed\n");
+      exit();
+    }
+  }
+  iostat(&st1);
+  // blocks logged before the test may go home too
+  if(st1.ninstall - st0.ninstall >= 30*20/2 + LOGSIZE){
+    printf(1, "checkpoint: %d blocks installed\n",
+           st1.ninstall - st0.ninstall);
+    exit();
+  }
+  for(b = 0; b < 20; b++){
+    if(pread(fd, buf, BSIZE, b*BSIZE) != BSIZE || buf[0] != b ||
+       buf[1] != 29 || buf[BSIZE-1] != 29){
+      printf(1, "checkpoint: block %d has wrong data\n", b);
+      exit();
+    }
+  }
+  close(fd);
+
+  unlink("ckfile");
+  fd = open("ckfile2", O_CREATE|O_RDWR);
+  for(b = 0; fd >= 0 && b < 20; b++){
+    memset(buf, 100, BSIZE);
+    buf[0] = b;
+    if(write(fd, buf, BSIZE) != BSIZE)
+      break;
+  }
+  if(fd < 0 || b < 20 || sync() != 0){
+    printf(1, "checkpoint: rewrite failed\n");
+    exit();
+  }
+  for(b = 0; b < 20; b++){
+    if(pread(fd, buf, BSIZE, b*BSIZE) != BSIZE || buf[0] != b ||
+       buf[1] != 100 || buf[BSIZE-1] != 100){
+      printf(1, "checkpoint: reused block %d has wrong data\n", b);
+      exit();
+    }
+  }
+  close(fd);
+  if(open("ckfile", O_RDONLY) >= 0){
+    printf(1, "checkpoint: unlinked file still there\n");
+    exit();
+  }
+  unlink("ckfile2");
+  printf(1, "checkpoint ok\n");
+}
+
 // four processes create and delete different files in same directory
 void
 createdelete(void)
@@ -931,86 +1354,307 @@ bigdir(void)
   printf(1, "bigdir ok\n");
 }
 
-void
-subdir(void)
+#define NDIRBENCH 10000
+
+static void
+dbname(char *name, int i)
 {
-  int fd, cc;
+  int j;
 
-  printf(1, "subdir test\n");
+  name[0] = 'f';
+  for(j = 5; j > 0; j--, i /= 10)
+    name[j] = '0' + i % 10;
+  name[6] = '\0';
+}
 
-  unlink("ff");
-  if(mkdir("dd") != 0){
-    printf(1, "subdir mkdir dd failed\n");
+// Create, look up and remove NDIRBENCH files in one directory,
+// which the hashed directory index keeps from going quadratic.
+void
+dirbench(void)
+{
+  int i, fd, t0, t1, t2;
+  char name[8];
+
+  printf(1, "dirbench test\n");
+  if(mkdir("db") < 0 || chdir("db") < 0){
+    printf(1, "dirbench: mkdir failed\n");
     exit();
   }
 
-  fd = open("dd/ff", O_CREATE | O_RDWR);
-  if(fd < 0){
-    printf(1, "create dd/ff failed\n");
-    exit();
+  t0 = uptime();
+  for(i = 0; i < NDIRBENCH; i++){
+    dbname(name, i);
+    if((fd = open(name, O_CREATE)) < 0){
+      printf(1, "dirbench: create %s failed\n", name);
+      exit();
+    }
+    close(fd);
+  }
+  t1 = uptime();
+  for(i = 0; i < NDIRBENCH; i++){
+    dbname(name, i);
+    if((fd = open(name, 0)) < 0){
+      printf(1, "dirbench: open %s failed\n", name);
+      exit();
+    }
+    close(fd);
+  }
+  t2 = uptime();
+  for(i = 0; i < NDIRBENCH; i++){
+    dbname(name, i);
+    if(unlink(name) < 0){
+      printf(1, "dirbench: unlink %s failed\n", name);
+      exit();
+    }
   }
-  write(fd, "ff", 2);
-  close(fd);
 
-  if(unlink("dd") >= 0){
-    printf(1, "unlink dd (non-empty dir) succeeded!\n");
+  if(chdir("..") < 0 || unlink("db") < 0){
+    printf(1, "dirbench: unlink db failed\n");
     exit();
   }
+  printf(1, "dirbench ok: %d creates in %d ticks, %d lookups in %d ticks\n",
+         NDIRBENCH, t1 - t0, NDIRBENCH, t2 - t1);
+}
 
-  if(mkdir("/dd/dd") != 0){
-    printf(1, "subdir mkdir dd/dd failed\n");
-    exit();
+// FNV-1a, as the kernel hashes directory entry names.
+static uint
+namehash(char *name)
+{
+  uint h;
+
+  h = 2166136261;
+  for(; *name; name++){
+    h ^= (uchar)*name;
+    h *= 16777619;
   }
+  return h;
+}
 
-  fd = open("dd/dd/ff", O_CREATE | O_RDWR);
+#define NCOLLIDE 300  // more than one directory block holds
+
+// Names whose hashes agree in more bits than a directory's hash
+// table can use must land in one bucket, which overflows.
+void
+collidedir(void)
+{
+  static char names[NCOLLIDE][8];
+  int i, j, k, n, fd;
+  uint h0;
+
+  printf(1, "collidedir test\n");
+  if(mkdir("cd") < 0 || chdir("cd") < 0){
+    printf(1, "collidedir: mkdir failed\n");
+    exit();
+  }
+  fd = open("f", O_CREATE);
   if(fd < 0){
-    printf(1, "create dd/dd/ff failed\n");
+    printf(1, "collidedir: create failed\n");
     exit();
   }
-  write(fd, "FF", 2);
   close(fd);
 
-  fd = open("dd/dd/../ff", 0);
-  if(fd < 0){
-    printf(1, "open dd/dd/../ff failed\n");
+  h0 = 0;
+  for(i = n = 0; n < NCOLLIDE; i++){
+    names[n][0] = 'c';
+    for(j = 1, k = i; j < 7; j++, k /= 26)
+      names[n][j] = 'a' + k % 26;
+    names[n][7] = '\0';
+    if(n == 0)
+      h0 = namehash(names[0]);
+    if(((namehash(names[n]) ^ h0) & ((1 << DIRMAXDEPTH) - 1)) == 0)
+      n++;
+  }
+  for(i = 0; i < NCOLLIDE; i++){
+    if(link("f", names[i]) != 0){
+      printf(1, "collidedir: link %s failed\n", names[i]);
+      exit();
+    }
+  }
+  for(i = 0; i < NCOLLIDE; i++){
+    if((fd = open(names[i], 0)) < 0){
+      printf(1, "collidedir: open %s failed\n", names[i]);
+      exit();
+    }
+    close(fd);
+  }
+  if(link("f", names[0]) == 0 || open("cX", 0) >= 0){
+    printf(1, "collidedir: duplicate link succeeded\n");
     exit();
   }
-  cc = read(fd, buf, sizeof(buf));
-  if(cc != 2 || buf[0] != 'f'){
-    printf(1, "dd/dd/../ff wrong content\n");
+  for(i = 0; i < NCOLLIDE; i++){
+    if(unlink(names[i]) != 0){
+      printf(1, "collidedir: unlink %s failed\n", names[i]);
+      exit();
+    }
+  }
+  if(unlink("f") != 0 || chdir("..") < 0 || unlink("cd") < 0){
+    printf(1, "collidedir: unlink cd failed\n");
     exit();
   }
-  close(fd);
+  printf(1, "collidedir ok\n");
+}
 
-  if(link("dd/dd/ff", "dd/dd/ffff") != 0){
-    printf(1, "link dd/dd/ff dd/dd/ffff failed\n");
+// Lookups are cached, misses included.  A name that was looked up
+// and not found must be found once created, and a name that is
+// unlinked and created again must lead to the new inode, also
+// through a directory that was itself removed and recreated.
+void
+dcachetest(void)
+{
+  struct stat st, st1;
+  int fd, fd1, pid;
+
+  printf(1, "dcache test\n");
+  if(open("dcx", O_RDONLY) >= 0 || stat("dcx", &st) >= 0){
+    printf(1, "dcache: dcx exists\n");
     exit();
   }
-
-  if(unlink("dd/dd/ff") != 0){
-    printf(1, "unlink dd/dd/ff failed\n");
+  fd = open("dcx", O_CREATE|O_RDWR);
+  if(fd < 0 || stat("dcx", &st) < 0 || st.type != T_FILE){
+    printf(1, "dcache: dcx not found after create\n");
     exit();
   }
-  if(open("dd/dd/ff", O_RDONLY) >= 0){
-    printf(1, "open (unlinked) dd/dd/ff succeeded\n");
+  if(stat("dcy", &st1) >= 0 || link("dcx", "dcy") < 0 ||
+     stat("dcy", &st1) < 0 || st1.ino != st.ino){
+    printf(1, "dcache: dcy not found after link\n");
     exit();
   }
 
-  if(chdir("dd") != 0){
-    printf(1, "chdir dd failed\n");
+  // fd keeps the old inode, so the new dcx must get another
+  if(unlink("dcx") < 0 || stat("dcx", &st1) >= 0){
+    printf(1, "dcache: dcx found after unlink\n");
     exit();
   }
-  if(chdir("dd/../../dd") != 0){
-    printf(1, "chdir dd/../../dd failed\n");
+  if(mkdir("dcx") < 0 || stat("dcx", &st1) < 0 ||
+     st1.type != T_DIR || st1.ino == st.ino){
+    printf(1, "dcache: dcx is not the new directory\n");
     exit();
   }
-  if(chdir("dd/../../../dd") != 0){
-    printf(1, "chdir dd/../../dd failed\n");
+  if(fstat(fd, &st1) < 0 || st1.ino != st.ino){
+    printf(1, "dcache: open file lost its inode\n");
     exit();
   }
-  if(chdir("./..") != 0){
-    printf(1, "chdir ./.. failed\n");
-    exit();
+  close(fd);
+
+  // another process's miss is not left behind either
+  pid = fork();
+  if(pid == 0){
+    if(stat("dcx/f", &st1) >= 0)
+      printf(1, "dcache: dcx/f exists\n");
+    exit();
+  }
+  wait();
+  fd = open("dcx/f", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "old", 4) != 4){
+    printf(1, "dcache: create dcx/f failed\n");
+    exit();
+  }
+  close(fd);
+
+  // through a directory removed and made again
+  if(unlink("dcx/f") < 0 || unlink("dcx") < 0 || open("dcx/f", O_RDONLY) >= 0){
+    printf(1, "dcache: dcx/f found after unlink\n");
+    exit();
+  }
+  if(mkdir("dcx") < 0 || open("dcx/f", O_RDONLY) >= 0){
+    printf(1, "dcache: dcx/f found in new dcx\n");
+    exit();
+  }
+  fd = open("dcx/f", O_CREATE|O_RDWR);
+  fd1 = open("dcx/f", O_RDONLY);
+  if(fd < 0 || fd1 < 0 || write(fd, "new", 4) != 4 ||
+     read(fd1, buf, 4) != 4 || strcmp(buf, "new") != 0){
+    printf(1, "dcache: dcx/f is not the new file\n");
+    exit();
+  }
+  close(fd);
+  close(fd1);
+  unlink("dcx/f");
+  unlink("dcx");
+  unlink("dcy");
+  printf(1, "dcache ok\n");
+}
+
+void
+subdir(void)
+{
+  int fd, cc;
+
+  printf(1, "subdir test\n");
+
+  unlink("ff");
+  if(mkdir("dd") != 0){
+    printf(1, "subdir mkdir dd failed\n");
+    exit();
+  }
+
+  fd = open("dd/ff", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf(1, "create dd/ff failed\n");
+    exit();
+  }
+  write(fd, "ff", 2);
+  close(fd);
+
+  if(unlink("dd") >= 0){
+    printf(1, "unlink dd (non-empty dir) succeeded!\n");
+    exit();
+  }
+
+  if(mkdir("/dd/dd") != 0){
+    printf(1, "subdir mkdir dd/dd failed\n");
+    exit();
+  }
+
+  fd = open("dd/dd/ff", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf(1, "create dd/dd/ff failed\n");
+    exit();
+  }
+  write(fd, "FF", 2);
+  close(fd);
+
+  fd = open("dd/dd/../ff", 0);
+  if(fd < 0){
+    printf(1, "open dd/dd/../ff failed\n");
+    exit();
+  }
+  cc = read(fd, buf, sizeof(buf));
+  if(cc != 2 || buf[0] != 'f'){
+    printf(1, "dd/dd/../ff wrong content\n");
+    exit();
+  }
+  close(fd);
+
+  if(link("dd/dd/ff", "dd/dd/ffff") != 0){
+    printf(1, "link dd/dd/ff dd/dd/ffff failed\n");
+    exit();
+  }
+
+  if(unlink("dd/dd/ff") != 0){
+    printf(1, "unlink dd/dd/ff failed\n");
+    exit();
+  }
+  if(open("dd/dd/ff", O_RDONLY) >= 0){
+    printf(1, "open (unlinked) dd/dd/ff succeeded\n");
+    exit();
+  }
+
+  if(chdir("dd") != 0){
+    printf(1, "chdir dd failed\n");
+    exit();
+  }
+  if(chdir("dd/../../dd") != 0){
+    printf(1, "chdir dd/../../dd failed\n");
+    exit();
+  }
+  if(chdir("dd/../../../dd") != 0){
+    printf(1, "chdir dd/../../dd failed\n");
+    exit();
+  }
+  if(chdir("./..") != 0){
+    printf(1, "chdir ./.. failed\n");
+    exit();
   }
 
   fd = open("dd/dd/ffff", 0);
@@ -1200,6 +1844,159 @@ bigfile(void)
   printf(1, "bigfile test ok\n");
 }
 
+#define NBCBLOCK 64
+
+// Processes reading the same cached blocks at once meet in their
+// hash buckets.  Each must find the one cached copy of a block:
+// every lookup is a hit, and none misses and reads a second copy.
+void
+bcachetest(void)
+{
+  struct iostat st0, st1;
+  int fd, fds[2], pi, i, j, b, ok;
+  char c;
+
+  printf(1, "bcache test\n");
+  fd = open("bcfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "bcache: create failed\n");
+    exit();
+  }
+  for(i = 0; i < NBCBLOCK; i++){
+    memset(buf, i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf(1, "bcache: write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+  if(pipe(fds) != 0){
+    printf(1, "bcache: pipe failed\n");
+    exit();
+  }
+  sync();  // no commit may read blocks in the middle
+  iostat(&st0);
+  for(pi = 0; pi < 4; pi++){
+    if(fork() == 0){
+      close(fds[0]);
+      fd = open("bcfile", O_RDONLY);
+      ok = fd >= 0;
+      // each starts at a different block and wraps around
+      for(i = 0; ok && i < 5*NBCBLOCK; i++){
+        b = (pi*NBCBLOCK/4 + i) % NBCBLOCK;
+        if(pread(fd, buf, BSIZE, b*BSIZE) != BSIZE)
+          ok = 0;
+        for(j = 0; ok && j < BSIZE; j++)
+          if(buf[j] != (char)b)
+            ok = 0;
+      }
+      write(fds[1], ok ? "y" : "n", 1);
+      exit();
+    }
+  }
+  close(fds[1]);
+  for(pi = 0; pi < 4; pi++){
+    if(read(fds[0], &c, 1) != 1 || c != 'y'){
+      printf(1, "bcache: reader saw wrong data\n");
+      exit();
+    }
+    wait();
+  }
+  close(fds[0]);
+  iostat(&st1);
+  if(st1.misses != st0.misses || st1.hits - st0.hits < 4*5*NBCBLOCK){
+    printf(1, "bcache: %d misses, %d hits\n", st1.misses - st0.misses,
+           st1.hits - st0.hits);
+    exit();
+  }
+  unlink("bcfile");
+  printf(1, "bcache ok\n");
+}
+
+#define NSCANBLOCK 600
+
+// Streaming through a big file must not push frequently used blocks,
+// such as inodes and directory blocks, out of the buffer cache:
+// afterwards, re-reading a few small, hot files finds every block
+// in the cache.
+void
+scantest(void)
+{
+  char hot[8];
+  struct iostat st0, st1;
+  struct stat st;
+  int fd, i, j;
+
+  printf(1, "scan test\n");
+  strcpy(hot, "hot0");
+  for(i = 0; i < 5; i++){
+    hot[3] = '0' + i;
+    fd = open(hot, O_CREATE|O_RDWR);
+    if(fd < 0 || write(fd, hot, 5) != 5){
+      printf(1, "scan: create failed\n");
+      exit();
+    }
+    close(fd);
+  }
+  // use each twice, to make its blocks hot
+  for(j = 0; j < 2; j++){
+    for(i = 0; i < 5; i++){
+      hot[3] = '0' + i;
+      fd = open(hot, O_RDONLY);
+      if(fd < 0 || read(fd, buf, sizeof(buf)) != 5 || fstat(fd, &st) < 0){
+        printf(1, "scan: read failed\n");
+        exit();
+      }
+      close(fd);
+    }
+  }
+
+  fd = open("scanfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "scan: create scanfile failed\n");
+    exit();
+  }
+  memset(buf, 's', BSIZE);
+  for(i = 0; i < NSCANBLOCK; i++){
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf(1, "scan: write scanfile failed\n");
+      exit();
+    }
+  }
+  close(fd);
+  for(j = 0; j < 2; j++){
+    fd = open("scanfile", O_RDONLY);
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+  // no commit may read log or home blocks in the middle
+  sync();
+
+  iostat(&st0);
+  for(i = 0; i < 5; i++){
+    hot[3] = '0' + i;
+    fd = open(hot, O_RDONLY);
+    if(fd < 0 || read(fd, buf, sizeof(buf)) != 5 || strcmp(buf, hot) != 0){
+      printf(1, "scan: hot file has wrong data\n");
+      exit();
+    }
+    close(fd);
+  }
+  iostat(&st1);
+  if(st1.misses != st0.misses || st1.nhot == 0){
+    printf(1, "scan: hot blocks evicted by scan (%d misses)\n",
+           st1.misses - st0.misses);
+    exit();
+  }
+  unlink("scanfile");
+  for(i = 0; i < 5; i++){
+    hot[3] = '0' + i;
+    unlink(hot);
+  }
+  printf(1, "scan ok\n");
+}
+
 void
 fourteen(void)
 {
@@ -1373,6 +2170,106 @@ iref(void)
   printf(1, "empty file name OK\n");
 }
 
+#define NICPROC 5
+#define NICFILE 14  // per process, within NOFILE
+
+// The inode cache grows past NINODE when more inodes are in use.
+// Several processes together hold open more than NINODE distinct
+// files; while they do, the parent looks up every one and creates
+// more, and then each process reads back its files.
+void
+icachetest(void)
+{
+  char name[4];
+  struct stat st;
+  int fd[NICFILE], ready[2], go[2], pi, i, n;
+  char c;
+
+  printf(1, "icache test\n");
+  name[0] = 'i';
+  name[3] = '\0';
+  n = NICPROC * NICFILE;
+  for(i = 0; i < n; i++){
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    fd[0] = open(name, O_CREATE|O_RDWR);
+    if(fd[0] < 0 || write(fd[0], name, 4) != 4){
+      printf(1, "icache: create failed\n");
+      exit();
+    }
+    close(fd[0]);
+  }
+  if(pipe(ready) != 0 || pipe(go) != 0){
+    printf(1, "icache: pipe failed\n");
+    exit();
+  }
+  for(pi = 0; pi < NICPROC; pi++){
+    if(fork() == 0){
+      close(ready[0]);
+      close(go[1]);
+      c = 'y';
+      for(i = 0; i < NICFILE; i++){
+        name[1] = '0' + (pi*NICFILE + i) / 10;
+        name[2] = '0' + (pi*NICFILE + i) % 10;
+        if((fd[i] = open(name, O_RDONLY)) < 0)
+          c = 'n';
+      }
+      write(ready[1], "r", 1);
+      read(go[0], buf, 1);
+      for(i = 0; c == 'y' && i < NICFILE; i++){
+        name[1] = '0' + (pi*NICFILE + i) / 10;
+        name[2] = '0' + (pi*NICFILE + i) % 10;
+        if(read(fd[i], buf, 4) != 4 || strcmp(buf, name) != 0)
+          c = 'n';
+      }
+      write(ready[1], &c, 1);
+      exit();
+    }
+  }
+  close(ready[1]);
+  close(go[0]);
+  for(pi = 0; pi < NICPROC; pi++){
+    if(read(ready[0], &c, 1) != 1){
+      printf(1, "icache: child failed\n");
+      exit();
+    }
+  }
+
+  // all n are in use now
+  for(i = 0; i < n; i++){
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    if(stat(name, &st) < 0 || st.size != 4){
+      printf(1, "icache: stat %s failed\n", name);
+      exit();
+    }
+  }
+  fd[0] = open("icnew", O_CREATE|O_RDWR);
+  if(fd[0] < 0){
+    printf(1, "icache: create with cache full failed\n");
+    exit();
+  }
+  close(fd[0]);
+
+  write(go[1], buf, NICPROC);
+  for(pi = 0; pi < NICPROC; pi++){
+    if(read(ready[0], &c, 1) != 1 || c != 'y'){
+      printf(1, "icache: child read wrong data\n");
+      exit();
+    }
+    wait();
+  }
+  close(ready[0]);
+  close(go[1]);
+  unlink("icnew");
+  for(i = 0; i < n; i++){
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    unlink(name);
+  }
+  printf(1, "icache ok\n");
+}
+
 // test that fork fails gracefully
 // the forktest binary also does this, but it runs out of proc entries first.
 // inside the bigger usertests binary, we run out of memory first.
@@ -1546,6 +2443,145 @@ sbrktest(void)
   printf(stdout, "sbrk test OK\n");
 }
 
+// Fork a child that reads kernel address a, which must kill it.
+void
+kernread(char *a)
+{
+  int pid, ppid;
+
+  ppid = getpid();
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    printf(stdout, "oops could read %x = %x\n", a, *a);
+    kill(ppid);
+    exit();
+  }
+  wait();
+}
+
+// Above its first 4MB the kernel maps memory and devices with 4MB
+// superpages, which must not be user-accessible.
+void
+superpagetest(void)
+{
+  static uint addrs[] = {
+    KERNBASE+0x400000, KERNBASE+0x1000000, KERNBASE+PHYSTOP-1,
+    DEVSPACE, 0xFFFFFFFF
+  };
+  int i;
+
+  printf(stdout, "superpage test\n");
+  for(i = 0; i < sizeof(addrs)/sizeof(addrs[0]); i++)
+    kernread((char*)addrs[i]);
+  printf(stdout, "superpage ok\n");
+}
+
+// Every page directory shares its kernel half with kpgdir.  Building
+// and tearing down many address spaces, by fork, growth, exec and
+// exit, must leave the kernel's mappings intact and out of user reach.
+void
+kpgdirtest(void)
+{
+  char *args[] = { "echo", "kpgdir", 0 };
+  int i, pid, ppid;
+  char *a;
+
+  printf(stdout, "kpgdir test\n");
+  ppid = getpid();
+  for(i = 0; i < 100; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "kpgdir: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      // more than one page table's worth, so exit frees several
+      a = sbrk(8*1024*1024);
+      if(a == (char*)0xffffffff){
+        printf(stdout, "kpgdir: sbrk failed\n");
+        kill(ppid);
+        exit();
+      }
+      a[0] = a[8*1024*1024-1] = 1;
+      if(i % 2){
+        close(1);
+        exec("echo", args);
+        printf(2, "kpgdir: exec failed\n");
+        kill(ppid);
+      }
+      exit();
+    }
+    wait();
+  }
+  kernread((char*)KERNBASE);
+  kernread((char*)KERNLINK);
+  kernread((char*)(KERNBASE+PHYSTOP-1));
+  printf(stdout, "kpgdir ok\n");
+}
+
+// Kernel mappings are global and survive the lcr3() of a context
+// switch; user mappings must not.  A parent and a child hold
+// different data at the same address and take turns many times,
+// each checking that it still sees its own.
+void
+tlbtest(void)
+{
+  int p1[2], p2[2], i, pid;
+  int *a;
+  char c;
+
+  printf(stdout, "tlb test\n");
+  a = (int*)sbrk(4096);
+  if(a == (int*)0xffffffff || pipe(p1) != 0 || pipe(p2) != 0){
+    printf(stdout, "tlb: setup failed\n");
+    exit();
+  }
+  *a = 0;
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "tlb: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(p1[1]);
+    close(p2[0]);
+    *a = 1000000;
+    for(i = 0; i < 1000; i++){
+      if(read(p1[0], &c, 1) != 1)
+        break;
+      if(*a != 1000000 + i){
+        printf(stdout, "tlb: child sees %d\n", *a);
+        break;
+      }
+      (*a)++;
+      write(p2[1], &c, 1);
+    }
+    exit();
+  }
+  close(p1[0]);
+  close(p2[1]);
+  for(i = 0; i < 1000; i++){
+    if(write(p1[1], "x", 1) != 1 || read(p2[0], &c, 1) != 1){
+      printf(stdout, "tlb: child failed\n");
+      exit();
+    }
+    if(*a != i){
+      printf(stdout, "tlb: parent sees %d\n", *a);
+      exit();
+    }
+    (*a)++;
+  }
+  close(p1[1]);
+  close(p2[0]);
+  wait();
+  sbrk(-4096);
+  printf(stdout, "tlb ok\n");
+}
+
 void
 validateint(int *p)
 {
@@ -1724,6 +2760,386 @@ uio()
   printf(1, "uio test done\n");
 }
 
+// Writes are buffered in the log until fsync() or sync().
+void
+synctest(void)
+{
+  int fd;
+  struct iostat st0, st1;
+
+  printf(stdout, "sync test\n");
+  iostat(&st0);
+  fd = open("syncfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "durable", 7) != 7){
+    printf(stdout, "sync: write failed\n");
+    exit();
+  }
+  // fsync() must not return until a commit holding the write
+  // is on disk.
+  if(fsync(fd) != 0 || fsync(-1) != -1){
+    printf(stdout, "sync: fsync failed\n");
+    exit();
+  }
+  iostat(&st1);
+  if(st1.ncommit <= st0.ncommit){
+    printf(stdout, "sync: fsync did not commit\n");
+    exit();
+  }
+  close(fd);
+  unlink("syncfile");
+  if(sync() != 0){
+    printf(stdout, "sync: sync failed\n");
+    exit();
+  }
+  printf(stdout, "sync ok\n");
+}
+
+#define NEVICT 300  // more inodes than the cache holds without growing
+
+// Fill memory so that the inode cache cannot grow.
+// The hog holds it until hold is closed.
+int
+hogmem(int hold[2])
+{
+  int ready[2], pid;
+  char c;
+
+  if(pipe(hold) != 0 || pipe(ready) != 0)
+    return -1;
+  pid = fork();
+  if(pid == 0){
+    close(hold[1]);
+    close(ready[0]);
+    while(sbrk(1024*1024) != (char*)0xffffffff)
+      ;
+    while(sbrk(4096) != (char*)0xffffffff)
+      ;
+    write(ready[1], "r", 1);
+    read(hold[0], &c, 1);
+    exit();
+  }
+  close(hold[0]);
+  close(ready[1]);
+  if(pid < 0 || read(ready[0], &c, 1) != 1)
+    pid = -1;
+  close(ready[0]);
+  return pid;
+}
+
+// fsync() must commit a file's updates even if its inode left the
+// inode cache after close() and was read in again.
+void
+fsyncevict(void)
+{
+  struct iostat st0, st1;
+  struct stat st;
+  char name[5];
+  int fd, hold[2], i;
+
+  printf(stdout, "fsync evict test\n");
+  if(hogmem(hold) < 0){
+    printf(stdout, "fsync evict: cannot fill memory\n");
+    exit();
+  }
+  name[0] = 'e';
+  name[4] = '\0';
+  for(i = 0; i < NEVICT; i++){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + i / 10 % 10;
+    name[3] = '0' + i % 10;
+    close(open(name, O_CREATE|O_RDWR));
+  }
+  sync();
+
+  iostat(&st0);
+  fd = open("evfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "durable", 7) != 7){
+    printf(stdout, "fsync evict: write failed\n");
+    exit();
+  }
+  close(fd);
+  // lookups only, so nothing is logged, until evfile is evicted
+  for(i = 0; i < NEVICT; i++){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + i / 10 % 10;
+    name[3] = '0' + i % 10;
+    stat(name, &st);
+  }
+  fd = open("evfile", O_RDWR);
+  if(fd < 0 || fsync(fd) != 0){
+    printf(stdout, "fsync evict: fsync failed\n");
+    exit();
+  }
+  iostat(&st1);
+  close(fd);
+  close(hold[1]);
+  wait();
+  if(st1.ncommit <= st0.ncommit){
+    printf(stdout, "fsync evict: fsync did not commit\n");
+    exit();
+  }
+  unlink("evfile");
+  for(i = 0; i < NEVICT; i++){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + i / 10 % 10;
+    name[3] = '0' + i % 10;
+    unlink(name);
+  }
+  printf(stdout, "fsync evict ok\n");
+}
+
+// sendfile() from a file into a pipe and into another file, and
+// splice() back out of the pipe.
+void
+sendfiletest(void)
+{
+  int fd, fd1, fds[2], i, n, pid;
+
+  printf(stdout, "sendfile test\n");
+  fd = open("sendfile", O_CREATE|O_RDWR);
+  for(i = 0; i < 4000; i++)
+    buf[i] = 'a' + i % 26;
+  if(fd < 0 || write(fd, buf, 4000) != 4000){
+    printf(stdout, "sendfile: write failed\n");
+    exit();
+  }
+  close(fd);
+
+  if(pipe(fds) != 0){
+    printf(stdout, "sendfile: pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "sendfile: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[0]);
+    fd = open("sendfile", O_RDONLY);
+    if(sendfile(fds[1], fd, 1000, 4000) != 3000 ||
+       sendfile(fds[1], fd, -1, 4000) != 4000 ||
+       sendfile(fds[1], fd, -1, 4000) != 0){
+      printf(stdout, "sendfile: sendfile to pipe failed\n");
+      exit();
+    }
+    exit();
+  }
+  close(fds[1]);
+  fd1 = open("sendfile1", O_CREATE|O_RDWR);
+  n = 0;
+  while((i = splice(fds[0], fd1, 4096)) > 0)
+    n += i;
+  wait();
+  if(n != 7000 || sendfile(fds[0], fd1, 0, 10) != -1 || splice(fd1, fd1, 10) != -1){
+    printf(stdout, "sendfile: splice failed, got %d\n", n);
+    exit();
+  }
+  close(fds[0]);
+  close(fd1);
+
+  fd1 = open("sendfile1", O_RDONLY);
+  if(read(fd1, buf, 7000) != 7000){
+    printf(stdout, "sendfile: read failed\n");
+    exit();
+  }
+  close(fd1);
+  for(i = 0; i < 7000; i++){
+    if(buf[i] != 'a' + (i < 3000 ? i + 1000 : i - 3000) % 26){
+      printf(stdout, "sendfile: wrong data at %d\n", i);
+      exit();
+    }
+  }
+  unlink("sendfile");
+  unlink("sendfile1");
+  printf(stdout, "sendfile ok\n");
+}
+
+// writev() and readv() of records, and pread() and pwrite(),
+// which leave the file offset alone.
+void
+uiovtest(void)
+{
+  int fd;
+  char a[5], b[7];
+  struct iovec iov[3];
+
+  printf(stdout, "readv test\n");
+  fd = open("uiovfile", O_CREATE|O_RDWR);
+  iov[0].base = "abcd";
+  iov[0].len = 4;
+  iov[1].base = "";
+  iov[1].len = 0;
+  iov[2].base = "efghij";
+  iov[2].len = 6;
+  if(fd < 0 || writev(fd, iov, 3) != 10){
+    printf(stdout, "readv: writev failed\n");
+    exit();
+  }
+  memset(b, 0, sizeof(b));
+  if(pwrite(fd, "XY", 2, 3) != 2 || pread(fd, b, 3, 2) != 3 ||
+     strcmp(b, "cXY") != 0 || write(fd, "k", 1) != 1){
+    printf(stdout, "readv: pread/pwrite failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("uiovfile", O_RDONLY);
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  iov[0].base = a;
+  iov[0].len = 4;
+  iov[1].base = b;
+  iov[1].len = 6;
+  if(readv(fd, iov, 2) != 10 || strcmp(a, "abcX") != 0 || strcmp(b, "Yfghij") != 0){
+    printf(stdout, "readv: readv failed\n");
+    exit();
+  }
+  if(readv(fd, iov, IOV_MAX+1) != -1 || readv(fd, iov, 2) != 1 ||
+     a[0] != 'k' || pread(fd, b, 1, -1) != -1){
+    printf(stdout, "readv: readv at end failed\n");
+    exit();
+  }
+  close(fd);
+  unlink("uiovfile");
+  printf(stdout, "readv ok\n");
+}
+
+// mmap() of a file and of anonymous memory.  Shared mappings
+// share pages with each other, across fork, and with read()
+// and write(); munmap() of a shared mapping writes it back.
+void
+mmaptest(void)
+{
+  int fd, fd1, i, pid;
+  char *p, *q;
+
+  printf(stdout, "mmap test\n");
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "mmap: create failed\n");
+    exit();
+  }
+  for(i = 0; i < 6000; i++)
+    buf[i] = 'a' + i % 26;
+  if(write(fd, buf, 6000) != 6000){
+    printf(stdout, "mmap: write failed\n");
+    exit();
+  }
+
+  p = mmap(0, 6000, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1){
+    printf(stdout, "mmap: mmap failed\n");
+    exit();
+  }
+  for(i = 0; i < 6000; i++){
+    if(p[i] != 'a' + i % 26){
+      printf(stdout, "mmap: wrong content at %d\n", i);
+      exit();
+    }
+  }
+  if(p[6000] != 0 || p[8191] != 0){
+    printf(stdout, "mmap: tail of last page not zero\n");
+    exit();
+  }
+  p[0] = 'X';
+  p[5999] = 'Y';
+
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "mmap: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(p[0] != 'X' || p[4096] != 'a' + 4096 % 26)
+      printf(stdout, "mmap: child sees wrong content\n");
+    p[1] = 'C';
+    exit();
+  }
+  wait();
+
+  // The child's store is in the page the parent maps, and so
+  // is the parent's after the child's write-back.
+  if(p[1] != 'C' || p[0] != 'X'){
+    printf(stdout, "mmap: child's store not shared\n");
+    exit();
+  }
+  // write() and read() see the same page as the mapping.
+  p[200] = 'R';
+  if(pwrite(fd, "W", 1, 100) != 1 || p[100] != 'W' ||
+     pread(fd, buf, 1, 200) != 1 || buf[0] != 'R'){
+    printf(stdout, "mmap: read/write not coherent with mapping\n");
+    exit();
+  }
+  // So does a separate mapping of the file.
+  fd1 = open("mmapfile", O_RDWR);
+  q = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd1, 0);
+  if(fd1 < 0 || q == (char*)-1 || q[0] != 'X' || q[1] != 'C'){
+    printf(stdout, "mmap: second mapping not shared\n");
+    exit();
+  }
+  q[2] = 'Q';
+  if(p[2] != 'Q'){
+    printf(stdout, "mmap: store to second mapping not seen\n");
+    exit();
+  }
+  // Another process could change a path in a shared mapping
+  // while the kernel uses it, so system calls refuse one.
+  strcpy(q + 8, "mmapfile");
+  if(open(q + 8, O_RDONLY) >= 0){
+    printf(stdout, "mmap: path in shared mapping accepted\n");
+    exit();
+  }
+  munmap(q, 4096);
+  close(fd1);
+
+  if(munmap(p, 6000) < 0){
+    printf(stdout, "mmap: munmap failed\n");
+    exit();
+  }
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, sizeof(buf)) != 6000 || buf[0] != 'X' || buf[5999] != 'Y' ||
+     buf[1] != 'C' || buf[2] != 'Q' || buf[100] != 'W' || buf[200] != 'R'){
+    printf(stdout, "mmap: munmap did not write back\n");
+    exit();
+  }
+
+  // The kernel must not store into a read-only mapping.
+  q = mmap(0, 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(q == (char*)-1 || q[0] != 'X'){
+    printf(stdout, "mmap: read-only mmap failed\n");
+    exit();
+  }
+  if(read(fd, q, 10) != -1){
+    printf(stdout, "mmap: read() into read-only mapping succeeded\n");
+    exit();
+  }
+  munmap(q, 4096);
+  close(fd);
+  unlink("mmapfile");
+
+  p = mmap(0, 3*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == (char*)-1 || p[0] != 0 || p[3*4096-1] != 0){
+    printf(stdout, "mmap: anonymous mmap failed\n");
+    exit();
+  }
+  p[4096] = 1;
+  // Punch a hole; the pages on either side stay mapped.
+  if(munmap(p + 4096, 4096) < 0){
+    printf(stdout, "mmap: partial munmap failed\n");
+    exit();
+  }
+  p[0] = 1;
+  p[2*4096] = 1;
+  if(munmap(p, 3*4096) < 0){
+    printf(stdout, "mmap: munmap failed\n");
+    exit();
+  }
+  printf(stdout, "mmap test ok\n");
+}
+
 void argptest()
 {
   int fd;
@@ -1756,23 +3172,33 @@ main(int argc, char *argv[])
   }
   close(open("usertests.ran", O_CREATE));
 
+  fsyncevict();  // before other tests grow the inode cache
   argptest();
   createdelete();
   linkunlink();
   concreate();
   fourfiles();
+  mergetest();
+  groupcommit();
+  logtest();
+  checkpointtest();
   sharedfd();
 
   bigargtest();
   bigwrite();
   bigargtest();
   bsstest();
+  lazytest();
   sbrktest();
+  superpagetest();
+  kpgdirtest();
+  tlbtest();
   validatetest();
 
   opentest();
   writetest();
   writetest1();
+  readaheadtest();
   createtest();
 
   openiputtest();
@@ -1787,15 +3213,25 @@ main(int argc, char *argv[])
   rmdot();
   fourteen();
   bigfile();
+  bcachetest();
+  scantest();
   subdir();
   linktest();
   unlinkread();
   dirfile();
   iref();
+  icachetest();
   forktest();
   bigdir(); // slow
+  dirbench(); // slow
+  collidedir(); // slow
+  dcachetest();
 
   uio();
+  mmaptest();
+  synctest();
+  sendfiletest();
+  uiovtest();
 
   exectest();
 
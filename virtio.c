@@ -0,0 +1,269 @@
+// Driver for a legacy (virtio 0.9.5) virtio-blk PCI disk, as
+// provided by QEMU with -device virtio-blk-pci.  Stands in for
+// ide.c, with the same interface, in kernelvirtio.
+//
+// Unlike the IDE disk, the device accepts many requests at once:
+// each is a chain of three descriptors (header, data, status) in
+// a ring shared with the device, and the device reports finished
+// chains in the used ring and interrupts.  Requests that do not
+// fit in the ring wait in the I/O scheduler (iosched.c).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "pci.h"
+
+#define SECTOR_SIZE   512
+
+// Legacy virtio PCI registers, at offsets from BAR0.
+#define VIRTIO_HOST_FEATURES   0x00
+#define VIRTIO_GUEST_FEATURES  0x04
+#define VIRTIO_QUEUE_PFN       0x08
+#define VIRTIO_QUEUE_SIZE      0x0c
+#define VIRTIO_QUEUE_SEL       0x0e
+#define VIRTIO_QUEUE_NOTIFY    0x10
+#define VIRTIO_STATUS          0x12
+#define VIRTIO_ISR             0x13
+#define VIRTIO_BLK_CAPACITY    0x14  // device config: size in sectors
+
+// Device status bits.
+#define VIRTIO_ACK             0x1
+#define VIRTIO_DRIVER          0x2
+#define VIRTIO_DRIVER_OK       0x4
+
+#define VRING_DESC_F_NEXT      0x1
+#define VRING_DESC_F_WRITE     0x2  // device writes the buffer
+
+#define VIRTIO_BLK_T_IN        0    // read
+#define VIRTIO_BLK_T_OUT       1    // write
+
+#define QMAX                   256  // largest ring we can hold
+
+struct vring_desc {
+  uint addr;
+  uint addrhi;
+  uint len;
+  ushort flags;
+  ushort next;
+};
+
+struct vring_avail {
+  ushort flags;
+  ushort idx;
+  ushort ring[];
+};
+
+struct vring_used_elem {
+  uint id;
+  uint len;
+};
+
+struct vring_used {
+  ushort flags;
+  ushort idx;
+  struct vring_used_elem ring[];
+};
+
+// Request header, read by the device.
+struct blkreq {
+  uint type;
+  uint reserved;
+  uint sector;
+  uint sectorhi;
+};
+
+// The ring must be physically contiguous and page aligned:
+// descriptors and available ring, then the used ring from the
+// next page boundary.
+static char vring[PGROUNDUP(16*QMAX + 2*(3+QMAX)) + PGROUNDUP(4 + 8*QMAX + 2)]
+  __attribute__((aligned(PGSIZE)));
+
+static struct spinlock vlock;
+static int iobase;
+static int qsize;
+static struct vring_desc *desc;
+static struct vring_avail *avail;
+static struct vring_used *used;
+static ushort usedidx;     // next used ring entry to look at
+static int freedesc;       // chain of free descriptors, through next
+static int nfree;
+static uint nblock;        // size of the disk, in blocks
+
+// Per-request state, indexed by the chain's first descriptor.
+static struct {
+  struct buf *b;
+  struct blkreq hdr;
+  uchar status;
+} info[QMAX];
+
+void
+ideinit(void)
+{
+  int f, i;
+
+  initlock(&vlock, "virtio");
+  if((f = pcifindid(0x1af4, 0x1001)) < 0)
+    panic("virtio: no block device");
+  pcimaster(f);
+  iobase = pciread(f, PCI_BAR0) & 0xfffc;
+
+  outb(iobase+VIRTIO_STATUS, 0);  // reset
+  outb(iobase+VIRTIO_STATUS, VIRTIO_ACK);
+  outb(iobase+VIRTIO_STATUS, VIRTIO_ACK|VIRTIO_DRIVER);
+  outl(iobase+VIRTIO_GUEST_FEATURES, 0);  // none needed
+  nblock = inl(iobase+VIRTIO_BLK_CAPACITY) / (BSIZE/SECTOR_SIZE);
+
+  outw(iobase+VIRTIO_QUEUE_SEL, 0);
+  qsize = inw(iobase+VIRTIO_QUEUE_SIZE);
+  if(qsize == 0 || qsize > QMAX)
+    panic("virtio: queue size");
+  desc = (struct vring_desc*)vring;
+  avail = (struct vring_avail*)(vring + qsize*sizeof(struct vring_desc));
+  used = (struct vring_used*)(vring +
+    PGROUNDUP(qsize*sizeof(struct vring_desc) + (3+qsize)*sizeof(ushort)));
+  for(i = 0; i < qsize; i++)
+    desc[i].next = i + 1;
+  freedesc = 0;
+  nfree = qsize;
+  outl(iobase+VIRTIO_QUEUE_PFN, V2P(vring) >> 12);
+
+  outb(iobase+VIRTIO_STATUS, VIRTIO_ACK|VIRTIO_DRIVER|VIRTIO_DRIVER_OK);
+
+  // trap() sends the disk vector to ideintr().
+  ioapicroute(pciread(f, PCI_INTR) & 0xff, T_IRQ0 + IRQ_IDE, ncpu - 1);
+}
+
+static int
+allocdesc(void)
+{
+  int d;
+
+  d = freedesc;
+  freedesc = desc[d].next;
+  nfree--;
+  return d;
+}
+
+static void
+freechain(int d)
+{
+  int next, more;
+
+  do {
+    more = desc[d].flags & VRING_DESC_F_NEXT;
+    next = desc[d].next;
+    desc[d].next = freedesc;
+    freedesc = d;
+    nfree++;
+    d = next;
+  } while(more);
+}
+
+// Put as many queued requests into the ring as fit, and tell
+// the device.  Caller must hold vlock.
+static void
+vstart(void)
+{
+  struct buf *b;
+  int d0, d1, d2, n;
+
+  n = 0;
+  while(nfree >= 3 && (b = iosched_next()) != 0){
+    if(b->blockno >= nblock)
+      panic("incorrect blockno");
+    d0 = allocdesc();
+    d1 = allocdesc();
+    d2 = allocdesc();
+
+    info[d0].b = b;
+    info[d0].hdr.type = (b->flags & B_DIRTY) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    info[d0].hdr.reserved = 0;
+    info[d0].hdr.sector = b->blockno * (BSIZE/SECTOR_SIZE);
+    info[d0].hdr.sectorhi = 0;
+    info[d0].status = 0xff;
+
+    desc[d0].addr = V2P(&info[d0].hdr);
+    desc[d0].addrhi = 0;
+    desc[d0].len = sizeof(info[d0].hdr);
+    desc[d0].flags = VRING_DESC_F_NEXT;
+    desc[d0].next = d1;
+
+    desc[d1].addr = V2P(b->data);
+    desc[d1].addrhi = 0;
+    desc[d1].len = BSIZE;
+    desc[d1].flags = VRING_DESC_F_NEXT;
+    if(!(b->flags & B_DIRTY))
+      desc[d1].flags |= VRING_DESC_F_WRITE;
+    desc[d1].next = d2;
+
+    desc[d2].addr = V2P(&info[d0].status);
+    desc[d2].addrhi = 0;
+    desc[d2].len = 1;
+    desc[d2].flags = VRING_DESC_F_WRITE;
+    desc[d2].next = 0;
+
+    avail->ring[(avail->idx + n) % qsize] = d0;
+    n++;
+  }
+  if(n == 0)
+    return;
+  __sync_synchronize();  // ring entries before the index
+  avail->idx += n;
+  __sync_synchronize();
+  outw(iobase+VIRTIO_QUEUE_NOTIFY, 0);
+}
+
+// Interrupt handler.
+void
+ideintr(void)
+{
+  struct vring_used_elem *e;
+  int d;
+
+  acquire(&vlock);
+  inb(iobase+VIRTIO_ISR);  // acknowledge; deasserts the line
+
+  __sync_synchronize();
+  while(usedidx != used->idx){
+    e = &used->ring[usedidx % qsize];
+    d = e->id;
+    if(info[d].status != 0)
+      panic("virtio: request failed");
+    biodone(info[d].b);
+    info[d].b = 0;
+    freechain(d);
+    usedidx++;
+  }
+
+  // Room in the ring: start waiting requests.
+  vstart();
+
+  release(&vlock);
+}
+
+//PAGEBREAK!
+// Queue b to be synced with disk.  Does not wait: ideintr()
+// calls biodone() when the request has finished.
+// If B_DIRTY is set, write buf to disk, else read it.
+void
+idesubmit(struct buf *b)
+{
+  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+    panic("idesubmit: nothing to do");
+  if(b->dev != ROOTDEV)
+    panic("idesubmit: request not for the virtio disk");
+
+  acquire(&vlock);
+  iosched_add(b);
+  vstart();
+  release(&vlock);
+}
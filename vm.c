@@ -5,7 +5,13 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 #include "elf.h"
+#include "stat.h"
+#include "fcntl.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -79,6 +85,37 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   return 0;
 }
 
+// Like mappages(), but map the parts of the range that are
+// 4MB-aligned in both va and pa with superpages (PTE_PS) instead
+// of page-table pages.  Used only for the kernel mappings in kmap[].
+static int
+mapkvm(pde_t *pgdir, void *va, uint size, uint pa, int perm)
+{
+  uint a, last;
+
+  a = PGROUNDDOWN((uint)va);
+  last = PGROUNDDOWN(((uint)va) + size - 1);
+  for(;;){
+    if(a % PTSIZE == 0 && pa % PTSIZE == 0 && last - a >= PTSIZE - PGSIZE){
+      if(pgdir[PDX(a)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(a)] = pa | perm | PTE_P | PTE_PS;
+      if(last - a == PTSIZE - PGSIZE)
+        break;
+      a += PTSIZE;
+      pa += PTSIZE;
+    } else {
+      if(mappages(pgdir, (void*)a, PGSIZE, pa, perm) < 0)
+        return -1;
+      if(a == last)
+        break;
+      a += PGSIZE;
+      pa += PGSIZE;
+    }
+  }
+  return 0;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
@@ -96,6 +133,12 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 //                                  rw data + free physical memory
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
+// Wherever a region is 4MB-aligned it is mapped with 4MB superpages
+// (see mapkvm), so most of the kernel half needs no page-table pages;
+// the kernel text stays in 4KB pages so it can remain read-only.
+// The kernel mappings are global (PTE_G, with CR4_PGE set in entry.S),
+// so the lcr3() in switchuvm() flushes only user translations.
+//
 // The kernel allocates physical memory for its heap and for user memory
 // between V2P(end) and the end of physical memory (PHYSTOP)
 // (directly addressable from end..P2V(PHYSTOP)).
@@ -115,32 +158,40 @@ static struct kmap {
 };
 
 // Set up kernel part of a page table.
+// The kernel mappings are the same in every address space, so
+// rather than building them again, share kpgdir's page-directory
+// entries (and with them its page-table pages).  Only the user
+// half of a page table belongs to the process.
 pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
   if((pgdir = (pde_t*)kalloc()) == 0)
     return 0;
   memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes.  Its kernel half is the one that
+// setupkvm() shares with every process, and it is never freed.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+
+  if((kpgdir = (pde_t*)kalloc()) == 0)
+    panic("kvmalloc");
+  memset(kpgdir, 0, PGSIZE);
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(mapkvm(kpgdir, k->virt, k->phys_end - k->phys_start,
+              (uint)k->phys_start, k->perm | PTE_G) < 0)
+      panic("kvmalloc");
   switchkvm();
 }
 
@@ -192,30 +243,6 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -279,7 +306,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  The kernel part is shared with kpgdir
+// (see setupkvm) and is left alone.
 void
 freevm(pde_t *pgdir)
 {
@@ -288,7 +316,7 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
@@ -323,10 +351,12 @@ copyuvm(pde_t *pgdir, uint sz)
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
+    // Image pages that have not been faulted in yet are
+    // left for the child to fault in from its own imgseg[].
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+      continue;
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
     if((mem = kalloc()) == 0)
@@ -352,7 +382,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -386,9 +416,555 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 }
 
 //PAGEBREAK!
-// Blank page.
+// Demand paging.
+//
+// exec() does not read the program into memory.  It records each
+// loadable segment in p->imgseg[] and leaves the pages below p->sz
+// unmapped.  The first access to such a page faults, and faultuvm()
+// allocates it, zero-fills it, and reads in whatever part of it is
+// backed by the executable.  Pages not covered by any segment (bss,
+// gaps between segments) are simply zero-filled.
+//
+// mmap() regions (p->vma[]) are filled in the same way, from the
+// mapped file or with zeroes.
+
+static char* shget(struct file*, uint);
+static int shput(struct file*, uint, char*, int);
+
+// Return the mmap() region of p that contains va, or 0.
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Read the parts of image page a that are backed by the
+// executable into mem.
+static int
+loadimgpage(struct proc *p, uint a, char *mem)
+{
+  struct imgseg *s;
+  uint start, end;
+  int r;
+
+  for(s = p->imgseg; s < &p->imgseg[NIMGSEG]; s++){
+    if(s->ip == 0 || a >= s->va + s->filesz || a + PGSIZE <= s->va)
+      continue;
+    start = a > s->va ? a : s->va;
+    end = a + PGSIZE < s->va + s->filesz ? a + PGSIZE : s->va + s->filesz;
+    ilock(s->ip);
+    r = readi(s->ip, mem + (start - a), s->off + (start - s->va), end - start);
+    iunlock(s->ip);
+    if(r != end - start)
+      return -1;
+  }
+  return 0;
+}
+
+// Fault in the page of p's image or mappings that contains va.
+// Returns 0 on success, or -1 if va is not a missing page of
+// either or there is no memory.
+int
+faultuvm(struct proc *p, uint va)
+{
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+  uint a, off;
+  int perm;
+
+  a = PGROUNDDOWN(va);
+  v = 0;
+  if(va < p->sz)
+    perm = PTE_W|PTE_U;
+  else if((v = findvma(p, va)) != 0 && (v->prot & (PROT_READ|PROT_WRITE)))
+    perm = (v->prot & PROT_WRITE) ? PTE_W|PTE_U : PTE_U;
+  else
+    return -1;
+  if((pte = walkpgdir(p->pgdir, (char*)a, 0)) != 0 && (*pte & PTE_P))
+    return -1;  // present: a protection fault, not ours
+  if(v && v->f && (v->flags & MAP_SHARED)){
+    off = v->off + (a - v->start);
+    if((mem = shget(v->f, off)) == 0)
+      return -1;
+    if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem), perm) < 0){
+      shput(v->f, off, mem, 0);
+      return -1;
+    }
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(v == 0){
+    if(loadimgpage(p, a, mem) < 0)
+      goto bad;
+  } else if(v->f){
+    // Past the end of the file the page stays zero.
+    filepread(v->f, mem, PGSIZE, v->off + (a - v->start));
+  }
+  if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem), perm) < 0)
+    goto bad;
+  return 0;
+
+bad:
+  kfree(mem);
+  return -1;
+}
+
+// Return the end of the part of p's address space (the image
+// below p->sz, or a mapping) that contains va, or 0 if va is
+// not a valid user address.
+uint
+limituvm(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  if(va < p->sz)
+    return p->sz;
+  if((v = findvma(p, va)) != 0)
+    return v->end;
+  return 0;
+}
+
+// Is [va, va+n) free of read-only mappings, so that the
+// kernel may store into it?
+int
+writableuvm(struct proc *p, uint va, uint n)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && va < v->end && va + n > v->start &&
+       (v->prot & PROT_WRITE) == 0)
+      return 0;
+  return 1;
+}
+
+// Does va lie in a MAP_SHARED file mapping, whose pages other
+// processes may store into at any time?
+int
+shareduvm(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  v = findvma(p, va);
+  return v != 0 && v->f != 0 && (v->flags & MAP_SHARED) != 0;
+}
+
+// Make sure the pages of p in [va, va+n) are present, so that
+// the kernel can use them directly.  The caller has checked
+// the range with limituvm().
+int
+touchuvm(struct proc *p, uint va, uint n)
+{
+  uint a;
+  pte_t *pte;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if((pte == 0 || (*pte & PTE_P) == 0) && faultuvm(p, a) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Drop the inode references held by an image's segment table.
+// Must be called inside a transaction since it calls iput().
+void
+freeimgseg(struct imgseg *seg)
+{
+  struct imgseg *s;
+
+  for(s = seg; s < &seg[NIMGSEG]; s++){
+    if(s->ip)
+      iputtext(s->ip);
+    s->ip = 0;
+  }
+}
+
 //PAGEBREAK!
-// Blank page.
+// Pages of MAP_SHARED file mappings.  Every mapping of a page
+// of an inode, in any process, maps the one physical page kept
+// here, and ref counts those PTEs.  readi() and writei() look
+// here too (shread(), shwrite()), so read() sees stores to a
+// mapping and mappings see write()s.  A process that unmaps a
+// page it dirtied writes the page back to the file.
+
+enum shstate { SH_FREE, SH_FILL, SH_LIVE };
+
+struct shpage {
+  enum shstate state;
+  struct inode *ip;
+  uint off;                    // Page-aligned offset in ip
+  char *mem;
+  int ref;                     // PTEs that map mem
+};
+
+struct {
+  struct spinlock lock;
+  int n;                       // pages not SH_FREE
+  struct shpage page[NSHPAGE];
+} shmem;
+
+void
+shinit(void)
+{
+  initlock(&shmem.lock, "shmem");
+}
+
+// Return the shared page for offset off of f's inode, with a
+// new reference, reading it in if it is not there yet.
+// Returns 0 if there is no memory or no free slot.
+static char*
+shget(struct file *f, uint off)
+{
+  struct shpage *sp, *free;
+  char *mem;
+
+  acquire(&shmem.lock);
+again:
+  free = 0;
+  for(sp = shmem.page; sp < &shmem.page[NSHPAGE]; sp++){
+    if(sp->state == SH_FREE){
+      if(free == 0)
+        free = sp;
+    } else if(sp->ip == f->ip && sp->off == off){
+      if(sp->state == SH_FILL){
+        sleep(sp, &shmem.lock);
+        goto again;
+      }
+      sp->ref++;
+      release(&shmem.lock);
+      return sp->mem;
+    }
+  }
+  if(free == 0 || (mem = kalloc()) == 0){
+    release(&shmem.lock);
+    return 0;
+  }
+  memset(mem, 0, PGSIZE);
+  sp = free;
+  sp->state = SH_FILL;
+  sp->ip = f->ip;
+  sp->off = off;
+  sp->mem = mem;
+  sp->ref = 1;
+  shmem.n++;
+  release(&shmem.lock);
+
+  // Past the end of the file the page stays zero.  writei()s
+  // from now on also go into mem, so none are missed.
+  filepread(f, mem, PGSIZE, off);
+
+  acquire(&shmem.lock);
+  sp->state = SH_LIVE;
+  wakeup(sp);
+  release(&shmem.lock);
+  return mem;
+}
+
+static struct shpage*
+shfind(char *mem)
+{
+  struct shpage *sp;
+
+  for(sp = shmem.page; sp < &shmem.page[NSHPAGE]; sp++)
+    if(sp->state == SH_LIVE && sp->mem == mem)
+      return sp;
+  panic("shfind");
+}
+
+// Add a reference to shared page mem, for fork.
+static void
+shdup(char *mem)
+{
+  acquire(&shmem.lock);
+  shfind(mem)->ref++;
+  release(&shmem.lock);
+}
+
+// Drop a reference to shared page mem, for offset off of f,
+// writing it back first if dirty is set.  Returns -1 if the
+// write-back failed, in which case the stores are lost once the
+// last reference goes.
+static int
+shput(struct file *f, uint off, char *mem, int dirty)
+{
+  struct stat st;
+  struct shpage *sp;
+  uint n;
+  int r;
+
+  r = 0;
+  if(dirty && filestat(f, &st) == 0 && off < st.size){
+    // Write back only the part of the page inside the file;
+    // a mapping never extends the file.
+    n = st.size - off < PGSIZE ? st.size - off : PGSIZE;
+    if(filepwrite(f, mem, n, off) != n)
+      r = -1;
+  }
+
+  acquire(&shmem.lock);
+  sp = shfind(mem);
+  if(--sp->ref > 0){
+    release(&shmem.lock);
+    return r;
+  }
+  sp->state = SH_FREE;
+  sp->ip = 0;
+  sp->mem = 0;
+  shmem.n--;
+  release(&shmem.lock);
+  kfree(mem);
+  return r;
+}
+
+// Copy the bytes of [off, off+n) of ip that are in shared pages
+// to or from addr.  Called by readi() and writei().
+static void
+shcopy(struct inode *ip, char *addr, uint off, uint n, int write)
+{
+  struct shpage *sp;
+  uint start, end;
+
+  if(shmem.n == 0)
+    return;
+  acquire(&shmem.lock);
+  for(sp = shmem.page; sp < &shmem.page[NSHPAGE]; sp++){
+    if(sp->state == SH_FREE || sp->ip != ip ||
+       off >= sp->off + PGSIZE || off + n <= sp->off)
+      continue;
+    start = off > sp->off ? off : sp->off;
+    end = off + n < sp->off + PGSIZE ? off + n : sp->off + PGSIZE;
+    if(write)
+      memmove(sp->mem + (start - sp->off), addr + (start - off), end - start);
+    else if(sp->state == SH_LIVE)
+      memmove(addr + (start - off), sp->mem + (start - sp->off), end - start);
+  }
+  release(&shmem.lock);
+}
+
+// A page that is still being read in is not copied from,
+// since it may not hold the file's data yet.
+void
+shread(struct inode *ip, char *dst, uint off, uint n)
+{
+  shcopy(ip, dst, off, n, 0);
+}
+
+void
+shwrite(struct inode *ip, char *src, uint off, uint n)
+{
+  shcopy(ip, src, off, n, 1);
+}
+
+// Does ip have pages in shared mappings?
+int
+shmapped(struct inode *ip)
+{
+  struct shpage *sp;
+  int r;
+
+  r = 0;
+  acquire(&shmem.lock);
+  for(sp = shmem.page; sp < &shmem.page[NSHPAGE]; sp++)
+    if(sp->state != SH_FREE && sp->ip == ip)
+      r = 1;
+  release(&shmem.lock);
+  return r;
+}
+
+//PAGEBREAK!
+// mmap() regions.
+
+// Create a mapping of len bytes for p, backed by f at offset off
+// (or anonymous if f is 0), and return its address.  Mappings are
+// placed below KERNBASE, as high as they fit.  Returns -1 if p has
+// no free vma slot or no room.
+int
+mmapuvm(struct proc *p, uint len, int prot, int flags, struct file *f, uint off)
+{
+  struct vma *v, *w;
+  uint a;
+
+  len = PGROUNDUP(len);
+  if(len == 0 || len >= KERNBASE)
+    return -1;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start == 0)
+      break;
+  if(v == &p->vma[NVMA])
+    return -1;
+
+  a = KERNBASE - len;
+again:
+  for(w = p->vma; w < &p->vma[NVMA]; w++){
+    if(w->start && a < w->end && a + len > w->start){
+      if(w->start < len)
+        return -1;
+      a = w->start - len;
+      goto again;
+    }
+  }
+  if(a < PGROUNDUP(p->sz))
+    return -1;
+
+  v->start = a;
+  v->end = a + len;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = f ? filedup(f) : 0;
+  v->off = off;
+  return a;
+}
+
+// Free the pages of v in [lo, hi).  Pages of a shared file
+// mapping are released instead, and written back to the file
+// if this mapping dirtied them.  Returns -1 if a write-back
+// failed; the pages are unmapped all the same.
+static int
+unmapvma(pde_t *pgdir, struct vma *v, uint lo, uint hi)
+{
+  pte_t *pte;
+  uint a;
+  char *mem;
+  int r;
+
+  r = 0;
+  for(a = lo; a < hi; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0 || (*pte & PTE_P) == 0)
+      continue;
+    mem = P2V(PTE_ADDR(*pte));
+    if((v->flags & MAP_SHARED) && v->f){
+      if(shput(v->f, v->off + (a - v->start), mem, *pte & PTE_D) < 0)
+        r = -1;
+    } else
+      kfree(mem);
+    *pte = 0;
+  }
+  return r;
+}
+
+// Remove p's mappings of [va, va+len), trimming or splitting
+// regions that are only partly covered.  The caller must flush
+// the TLB if p is running.  Returns -1 if the range is bad, or
+// if stores to a shared mapping could not be written back.
+int
+munmapuvm(struct proc *p, uint va, uint len)
+{
+  struct vma *v, *free;
+  uint end, lo, hi;
+  int r;
+
+  end = PGROUNDUP(va + len);
+  if(va % PGSIZE != 0 || len == 0 || end <= va || end > KERNBASE)
+    return -1;
+
+  // Punching a hole in a region needs a slot for the upper part.
+  free = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start == 0){
+      free = v;
+      break;
+    }
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && va > v->start && end < v->end && free == 0)
+      return -1;
+
+  r = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0 || va >= v->end || end <= v->start)
+      continue;
+    lo = va > v->start ? va : v->start;
+    hi = end < v->end ? end : v->end;
+    if(unmapvma(p->pgdir, v, lo, hi) < 0)
+      r = -1;
+    if(lo == v->start && hi == v->end){
+      if(v->f)
+        fileclose(v->f);
+      memset(v, 0, sizeof(*v));
+    } else if(lo == v->start){
+      v->off += hi - v->start;
+      v->start = hi;
+    } else if(hi == v->end){
+      v->end = lo;
+    } else {
+      *free = *v;
+      free->start = hi;
+      free->off = v->off + (hi - v->start);
+      if(free->f)
+        filedup(free->f);
+      v->end = lo;
+    }
+  }
+  return r;
+}
+
+// Remove all of p's mappings, as exit() and exec() do.
+void
+freevmas(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0)
+      continue;
+    if(unmapvma(p->pgdir, v, v->start, v->end) < 0)
+      cprintf("pid %d %s: lost stores to shared mapping\n", p->pid, p->name);
+    if(v->f)
+      fileclose(v->f);
+    memset(v, 0, sizeof(*v));
+  }
+}
+
+// Give the child np of p copies of p's mappings.  np->pgdir is
+// already set.  np gets copies of the pages p has touched,
+// except in MAP_SHARED file mappings, where it maps the same
+// pages as p.
+int
+copyvmas(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+  char *mem;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0)
+      continue;
+    np->vma[v - p->vma] = *v;
+    if(v->f)
+      filedup(v->f);
+    for(a = v->start; a < v->end; a += PGSIZE){
+      if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0 || (*pte & PTE_P) == 0)
+        continue;
+      if((v->flags & MAP_SHARED) && v->f){
+        mem = P2V(PTE_ADDR(*pte));
+        shdup(mem);
+      } else {
+        if((mem = kalloc()) == 0)
+          return -1;
+        memmove(mem, P2V(PTE_ADDR(*pte)), PGSIZE);
+      }
+      if(mappages(np->pgdir, (char*)a, PGSIZE, V2P(mem),
+                  PTE_FLAGS(*pte) & ~PTE_D) < 0){
+        if((v->flags & MAP_SHARED) && v->f)
+          shput(v->f, v->off + (a - v->start), mem, 0);
+        else
+          kfree(mem);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
 //PAGEBREAK!
 // Blank page.
 
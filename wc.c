@@ -1,29 +1,47 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "fcntl.h"
 
 char buf[512];
 
+void
+count(char *p, int n, int *l, int *w, int *c, int *inword)
+{
+  int i;
+
+  for(i=0; i<n; i++){
+    (*c)++;
+    if(p[i] == '\n')
+      (*l)++;
+    if(strchr(" \r\t\n\v", p[i]))
+      *inword = 0;
+    else if(!*inword){
+      (*w)++;
+      *inword = 1;
+    }
+  }
+}
+
 void
 wc(int fd, char *name)
 {
-  int i, n;
+  int n;
   int l, w, c, inword;
+  struct stat st;
+  char *p;
 
   l = w = c = 0;
   inword = 0;
-  while((n = read(fd, buf, sizeof(buf))) > 0){
-    for(i=0; i<n; i++){
-      c++;
-      if(buf[i] == '\n')
-        l++;
-      if(strchr(" \r\t\n\v", buf[i]))
-        inword = 0;
-      else if(!inword){
-        w++;
-        inword = 1;
-      }
-    }
+  // Map a regular file instead of copying it through buf.
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0)) != (char*)-1){
+    count(p, st.size, &l, &w, &c, &inword);
+    munmap(p, st.size);
+    n = 0;
+  } else {
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+      count(buf, n, &l, &w, &c, &inword);
   }
   if(n < 0){
     printf(1, "wc: read error\n");